@@ -0,0 +1,488 @@
+// pgts, the command line encoder and decoder. the output of encode is the same
+// value as ts.u8_encode or ts.f8_encode, e.g. load it with
+//
+//   select ts.u8_decode(pg_read_binary_file('/path/to/file'));
+#include "encode.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// the values encoded by a worker at a time, a multiple of the block so the
+// merged chunks are the same as one encoder
+#define CHUNK_SIZE (64 * TE_BLOCK_SIZE)
+
+typedef enum { TYPE_INT8, TYPE_FLOAT8 } ValueType;
+typedef enum { FORMAT_RAW, FORMAT_CSV } FileFormat;
+
+static struct {
+	ValueType type;
+	FileFormat format;
+	int threads;
+	bool verbose;
+} options = {.type = TYPE_INT8, .format = FORMAT_RAW, .threads = 1};
+
+static void *cli_realloc(void *p, size_t o __attribute__((unused)), size_t n)
+{
+	void *ret = p == NULL ? calloc(1, n) : realloc(p, n);
+	if (ret == NULL) {
+		fprintf(stderr, "pgts: out of memory\n");
+		exit(1);
+	}
+
+	return ret;
+}
+
+static double now_s()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+// the time and throughput of a stage, printed with -v
+static void stage_report(const char *stage, double start, size_t bytes)
+{
+	if (!options.verbose)
+		return;
+
+	double s = now_s() - start;
+	fprintf(stderr, "%-8s %10.3f ms %10.2f MiB/s\n", stage, s * 1e3, bytes / (1024.0 * 1024.0) / (s > 0 ? s : 1e-9));
+}
+
+// run fn(arg, i) for i in [0, n) on the threads, the next i is taken by the
+// first idle thread
+typedef struct Pool {
+	void (*fn)(void *arg, size_t i);
+	void *arg;
+	size_t n, next;
+	pthread_mutex_t lock;
+} Pool;
+
+static void *pool_worker(void *p)
+{
+	Pool *pool = p;
+	while (true) {
+		pthread_mutex_lock(&pool->lock);
+		size_t i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (i >= pool->n)
+			return NULL;
+
+		pool->fn(pool->arg, i);
+	}
+}
+
+static void pool_run(size_t n, void (*fn)(void *arg, size_t i), void *arg)
+{
+	Pool pool = {.fn = fn, .arg = arg, .n = n, .lock = PTHREAD_MUTEX_INITIALIZER};
+
+	size_t nthreads = (size_t)options.threads < n ? (size_t)options.threads : n;
+	pthread_t *threads = cli_realloc(NULL, 0, sizeof(pthread_t) * (nthreads > 0 ? nthreads : 1));
+	for (size_t t = 1; t < nthreads; ++t)
+		pthread_create(&threads[t], NULL, pool_worker, &pool);
+
+	pool_worker(&pool); // the main thread is a worker too
+
+	for (size_t t = 1; t < nthreads; ++t)
+		pthread_join(threads[t], NULL);
+
+	free(threads);
+}
+
+static unsigned char *map_file(const char *path, size_t *size)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "pgts: can not open %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+
+	*size = st.st_size;
+	unsigned char *p = NULL;
+	if (*size > 0 && (p = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		fprintf(stderr, "pgts: can not map %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+
+	close(fd);
+	return p;
+}
+
+static void write_file(const char *path, const void *data, size_t size)
+{
+	FILE *f = fopen(path, "wb");
+	if (f == NULL || fwrite(data, 1, size, f) != size || fclose(f) != 0) {
+		fprintf(stderr, "pgts: can not write %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+}
+
+// the csv is split to one range of lines for each thread. the lines are
+// counted first, then every range is parsed to its place of the values. only
+// the first field of a line is read, empty lines are skipped.
+typedef struct CsvParse {
+	const char *text;
+	size_t *starts, *counts; // the byte range and the number of lines of the range i: [starts[i], starts[i+1])
+	uint64_t *values;
+	size_t *offsets;
+	size_t *errors; // the 1 based index of the first invalid value of a range, 0 if no error
+} CsvParse;
+
+static void csv_count(void *arg, size_t i)
+{
+	CsvParse *p = arg;
+	size_t count = 0;
+	bool empty = true;
+	for (size_t c = p->starts[i]; c < p->starts[i + 1]; ++c) {
+		if (p->text[c] == '\n')
+			count += !empty, empty = true;
+		else if (p->text[c] != '\r')
+			empty = false;
+	}
+
+	p->counts[i] = count + !empty;
+}
+
+static void csv_parse(void *arg, size_t i)
+{
+	CsvParse *p = arg;
+	uint64_t *out = p->values + p->offsets[i];
+	for (size_t c = p->starts[i], end = p->starts[i + 1]; c < end;) {
+		size_t eol = c;
+		while (eol < end && p->text[eol] != '\n')
+			++eol;
+
+		bool empty = true;
+		for (size_t k = c; k < eol; ++k)
+			empty &= p->text[k] == '\r';
+
+		// the first field, copied to be terminated for strtoll / strtod. a field
+		// which does not fit is not a number of 8 bytes
+		char field[64];
+		size_t n = 0;
+		for (size_t k = c; k < eol && p->text[k] != ',' && p->text[k] != '\r'; ++k, ++n) {
+			if (n + 1 < sizeof(field))
+				field[n] = p->text[k];
+		}
+		field[n < sizeof(field) ? n : sizeof(field) - 1] = 0;
+		c = eol + 1;
+
+		if (empty)
+			continue;
+
+		// out of range is an error, but not the underflow of a double, which
+		// is rounded to a denormal or 0
+		char *tail = NULL;
+		bool range = false;
+		errno = 0;
+		if (options.type == TYPE_INT8) {
+			int64_t v = strtoll(field, &tail, 10);
+			range = errno == ERANGE;
+			memcpy(out, &v, 8);
+		} else {
+			float64_t v = strtod(field, &tail);
+			range = errno == ERANGE && isinf(v);
+			memcpy(out, &v, 8);
+		}
+
+		if ((n == 0 || n >= sizeof(field) || *tail != 0 || range) && p->errors[i] == 0)
+			p->errors[i] = out - p->values + 1;
+
+		++out;
+	}
+}
+
+static uint64_t *read_csv(const char *text, size_t size, size_t *count)
+{
+	size_t nranges = options.threads;
+	CsvParse p = {
+	    .text = text,
+	    .starts = cli_realloc(NULL, 0, (nranges + 1) * sizeof(size_t)),
+	    .counts = cli_realloc(NULL, 0, nranges * sizeof(size_t)),
+	    .offsets = cli_realloc(NULL, 0, nranges * sizeof(size_t)),
+	    .errors = cli_realloc(NULL, 0, nranges * sizeof(size_t)),
+	};
+
+	// a range starts after a newline
+	p.starts[0] = 0, p.starts[nranges] = size;
+	for (size_t i = 1; i < nranges; ++i) {
+		size_t c = size / nranges * i;
+		c = c > p.starts[i - 1] ? c : p.starts[i - 1];
+		while (c > 0 && c < size && text[c - 1] != '\n')
+			++c;
+
+		p.starts[i] = c;
+	}
+
+	pool_run(nranges, csv_count, &p);
+
+	*count = 0;
+	for (size_t i = 0; i < nranges; ++i)
+		p.offsets[i] = *count, *count += p.counts[i];
+
+	p.values = cli_realloc(NULL, 0, *count * 8 + 8);
+	memset(p.errors, 0, nranges * sizeof(size_t));
+	pool_run(nranges, csv_parse, &p);
+
+	// the ranges are in order, the first error of the first range is the first one
+	for (size_t i = 0; i < nranges; ++i) {
+		if (p.errors[i] != 0) {
+			fprintf(stderr, "pgts: the value %zu is not a valid number\n", p.errors[i]);
+			exit(1);
+		}
+	}
+
+	free(p.starts), free(p.counts), free(p.offsets), free(p.errors);
+	return p.values;
+}
+
+// every chunk is encoded by its own encoder, then they are merged in order
+typedef struct EncodeChunks {
+	uint64_t *values;
+	size_t count;
+	U8Encoder **encoders;
+	bool *failed; // of every chunk, so a worker writes only its own
+} EncodeChunks;
+
+static void encode_chunk(void *arg, size_t i)
+{
+	EncodeChunks *c = arg;
+	size_t n = c->count - i * CHUNK_SIZE < CHUNK_SIZE ? c->count - i * CHUNK_SIZE : CHUNK_SIZE;
+
+	c->encoders[i] = _u8_encoder_create(cli_realloc);
+	if (_u8_encoder_append_n(c->encoders[i], c->values + i * CHUNK_SIZE, n) != 0)
+		c->failed[i] = true;
+}
+
+static int encode(const char *input_path, const char *output_path)
+{
+	double start = now_s();
+	size_t input_sz = 0, count = 0;
+	unsigned char *input = map_file(input_path, &input_sz);
+	uint64_t *values = (uint64_t *)input;
+	stage_report("map", start, input_sz);
+
+	start = now_s();
+	if (options.format == FORMAT_CSV) {
+		values = read_csv((const char *)input, input_sz, &count);
+		stage_report("parse", start, input_sz);
+	} else if (input_sz % 8 != 0) {
+		fprintf(stderr, "pgts: the size of %s is not a multiple of 8\n", input_path);
+		return 1;
+	} else {
+		count = input_sz / 8;
+	}
+
+	start = now_s();
+	unsigned char *output = NULL;
+	size_t output_sz = 0;
+	if (options.type == TYPE_FLOAT8) {
+		// the parameters of the blocks of the decimal series are in front of
+		// the integers, the series is encoded in one thread whatever -j is
+		if (_f8_series_encode((float64_t *)values, count, &output, &output_sz, cli_realloc) != 0) {
+			fprintf(stderr, "pgts: too many values to encode\n");
+			return 1;
+		}
+	} else {
+		size_t nchunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		EncodeChunks c = {
+		    .values = values,
+		    .count = count,
+		    .encoders = cli_realloc(NULL, 0, (nchunks + 1) * sizeof(U8Encoder *)),
+		    .failed = cli_realloc(NULL, 0, nchunks + 1),
+		};
+		pool_run(nchunks, encode_chunk, &c);
+
+		bool failed = false;
+		U8Encoder *e = _u8_encoder_create(cli_realloc);
+		for (size_t i = 0; i < nchunks && !failed; ++i) {
+			failed = c.failed[i] || _u8_encoder_merge(e, c.encoders[i]) != 0;
+			_u8_encoder_free(c.encoders[i], free);
+		}
+
+		free(c.failed);
+		if (failed || _u8_encoder_finish(e, &output, &output_sz) != 0) {
+			fprintf(stderr, "pgts: too many values to encode\n");
+			return 1;
+		}
+	}
+	stage_report("encode", start, count * 8);
+
+	start = now_s();
+	write_file(output_path, output, output_sz);
+	stage_report("write", start, output_sz);
+
+	if (options.verbose)
+		fprintf(stderr, "%zu values, %zu -> %zu bytes\n", count, count * 8, output_sz);
+
+	return 0;
+}
+
+// the ranges of the values are decoded in parallel, each by its own decoder
+typedef struct DecodeRanges {
+	unsigned char *input;
+	size_t input_sz, count;
+	uint64_t *values;
+	bool *failed; // of every range, so a worker writes only its own
+} DecodeRanges;
+
+static void decode_range(void *arg, size_t i)
+{
+	DecodeRanges *r = arg;
+	size_t start = i * CHUNK_SIZE, n = r->count - start < CHUNK_SIZE ? r->count - start : CHUNK_SIZE, read = 0;
+
+	U8Decoder *d = _u8_decoder_create(r->input, r->input_sz, cli_realloc);
+	if (d == NULL || _u8_decoder_seek(d, start) != 0 || _u8_decoder_read(d, r->values + start, n, &read) != 0 ||
+	    read != n)
+		r->failed[i] = true;
+
+	if (d != NULL)
+		_u8_decoder_free(d, free);
+}
+
+static void write_csv(const char *path, uint64_t *values, size_t count)
+{
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "pgts: can not write %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		if (options.type == TYPE_INT8)
+			fprintf(f, "%" PRId64 "\n", (int64_t)values[i]);
+		else
+			fprintf(f, "%.17g\n", ((float64_t *)values)[i]);
+	}
+
+	if (fclose(f) != 0) {
+		fprintf(stderr, "pgts: can not write %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+}
+
+static int decode(const char *input_path, const char *output_path)
+{
+	double start = now_s();
+	size_t input_sz = 0, count = 0;
+	unsigned char *input = map_file(input_path, &input_sz);
+	stage_report("map", start, input_sz);
+
+	start = now_s();
+	uint64_t *values = NULL;
+	if (options.type == TYPE_FLOAT8) {
+		// the gorilla XOR of the values which are not decimals is decoded as a
+		// whole by every decoder, the series is decoded in one thread
+		size_t values_sz = 0;
+		if (_f8_series_decode(input, input_sz, (float64_t **)&values, &values_sz, cli_realloc) != 0) {
+			fprintf(stderr, "pgts: invalid f8 encoded data\n");
+			return 1;
+		}
+
+		count = values_sz / 8;
+	} else {
+		U8Decoder *d = _u8_decoder_create(input, input_sz, cli_realloc);
+		if (d == NULL) {
+			fprintf(stderr, "pgts: invalid u8 encoded data\n");
+			return 1;
+		}
+
+		count = _u8_decoder_count(d);
+		_u8_decoder_free(d, free);
+
+		size_t nranges = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		DecodeRanges r = {
+		    .input = input,
+		    .input_sz = input_sz,
+		    .count = count,
+		    .values = cli_realloc(NULL, 0, count * 8 + 8),
+		    .failed = cli_realloc(NULL, 0, nranges + 1),
+		};
+		pool_run(nranges, decode_range, &r);
+
+		bool failed = false;
+		for (size_t i = 0; i < nranges; ++i)
+			failed |= r.failed[i];
+
+		free(r.failed);
+		if (failed) {
+			fprintf(stderr, "pgts: invalid u8 encoded data\n");
+			return 1;
+		}
+
+		values = r.values;
+	}
+	stage_report("decode", start, count * 8);
+
+	start = now_s();
+	if (options.format == FORMAT_CSV)
+		write_csv(output_path, values, count);
+	else
+		write_file(output_path, values, count * 8);
+	stage_report("write", start, count * 8);
+
+	return 0;
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: pgts encode|decode [options] input output\n"
+		"\n"
+		"  -t int8|float8  the type of the values, int8 by default. timestamps are int8\n"
+		"  -f raw|csv      the format of the values, raw little-endian 8 bytes by default.\n"
+		"                  only the first field of a csv line is read\n"
+		"  -j threads      the number of threads, the number of cpus by default. the values\n"
+		"                  of float8 are encoded and decoded in one thread\n"
+		"  -v              print the time and throughput of every stage\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+		usage();
+
+	const char *command = argv[1];
+	options.threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	optind = 2;
+	for (int opt; (opt = getopt(argc, argv, "t:f:j:v")) != -1;) {
+		if (opt == 't' && strcmp(optarg, "int8") == 0)
+			options.type = TYPE_INT8;
+		else if (opt == 't' && strcmp(optarg, "float8") == 0)
+			options.type = TYPE_FLOAT8;
+		else if (opt == 'f' && strcmp(optarg, "raw") == 0)
+			options.format = FORMAT_RAW;
+		else if (opt == 'f' && strcmp(optarg, "csv") == 0)
+			options.format = FORMAT_CSV;
+		else if (opt == 'j' && atoi(optarg) > 0)
+			options.threads = atoi(optarg);
+		else if (opt == 'v')
+			options.verbose = true;
+		else
+			usage();
+	}
+
+	if (argc - optind != 2 || options.threads < 1)
+		usage();
+
+	if (strcmp(command, "encode") == 0)
+		return encode(argv[optind], argv[optind + 1]);
+	else if (strcmp(command, "decode") == 0)
+		return decode(argv[optind], argv[optind + 1]);
+
+	usage();
+	return 2;
+}
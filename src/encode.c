@@ -1,33 +1,255 @@
 #include "encode.h"
 
 #include <math.h>
+#include <pthread.h> // for the table of the dictionaries
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h> // for the scratch of f8_series_write
 #include <string.h>
-#include <zstd.h> // for ZSTD support
+#include <zdict.h> // for ZDICT_trainFromBuffer
+#include <zstd.h>  // for ZSTD support
+
+#if defined(__x86_64__)
+#	include <immintrin.h> // for SSE2 / AVX2
+#endif
 
 #define TE_VER_MASK 0b11000000 /* 4 binary version */
 #define TE__SZ_MASK 0b00110000 /* 4 type of size */
 #define TE___D_MASK 0b00001111 /* 2^4 type of payload */
 
 static const uint8_t __placeholder__ __attribute__((unused)) = 0, //
-    TE_VER = 0b00000000,					  //
+    TE_VER = 0b00000000, //
+    TE_VER1 = 0b01000000,					  // blocked series
+    TE_VER2 = 0b10000000,					  // row group of columns
+    TE_VER3 = 0b11000000,					  // values with nulls
     TE_SZ1 = 0b00010000,					  // 1 bytes length
     TE_SZ2 = 0b00100000,					  // 2 bytes length
     TE_SZ3 = 0b00110000,					  // 3 bytes length
     TE_DI8 = 0b00000001,					  // encoded int8   (8bytes)
     TE_DF8 = 0b00000010,					  // encoded float8 (8bytes)
+    TE_LIN = 0b00000011,					  // block of int8 with a constant delta
+    TE_RLE = 0b00000100,					  // block of int8 with runs of the same value
+    TE_FOR = 0b00000101,					  // block of int8 deltas packed with frame of reference
+    TE_PFR = 0b00000110,					  // block of int8 deltas packed in frames of 128 with exceptions
+    TE_REG = 0b00000111,					  // block of int8 on a regular period with runs of the same offset
+    TE_RGP = 0b00000000,					  // encoded columns of a row group, the only payload of TE_VER2
     TE_ZST = 0b00001000,					  // encoded with zstd
     __placeholder2__ __attribute__((unused)) = 0;
 
+// the contexts are created once and live as long as the thread (a backend of
+// postgres, or a worker of the command line tool), so a row does not pay the
+// setup of the context.
+static __thread ZSTD_CCtx *zstd_cctx = NULL;
+static __thread ZSTD_DCtx *zstd_dctx = NULL;
+
+#define ZSTD_FAILED ((size_t)-1) /* an error for ZSTD_isError */
+
+// the second stage of the bitstream. zstd is kept only when it saves more than
+// 1/TE_ZSTD_MIN_GAIN of the bitstream, the raw bitstream is stored otherwise
+// and decoded without decompression.
+#define TE_ZSTD_MIN_GAIN 16
+
+static int zstd_stage = TE_STAGE_ZSTD, zstd_level = 0;
+
+void _zstd_set_stage(int stage, int level) { zstd_stage = stage, zstd_level = level; }
+
+// the codec of the blocks, the smallest one or the fastest one to decode
+static int u8_codec = TE_CODEC_AUTO;
+
+void _u8_set_codec(int codec) { u8_codec = codec; }
+
+static inline bool zstd_pays(size_t raw_sz, size_t compressed_sz)
+{
+	return compressed_sz < raw_sz - raw_sz / TE_ZSTD_MIN_GAIN;
+}
+
+static bool zstd_is_frame(unsigned char *input, size_t input_sz)
+{
+	uint32_t magic = 0;
+	if (input_sz >= 4)
+		memcpy(&magic, input, 4);
+
+	return magic == ZSTD_MAGICNUMBER;
+}
+
+
+// the dictionaries of zstd, trained from the bitstream of encoded values. a
+// dictionary is digested to ZSTD_CDict / ZSTD_DDict once per process, the
+// frame header records the id of the dictionary it is compressed with.
+typedef struct ZstdDictionary {
+	uint32_t id;
+	ZSTD_CDict *cdict;
+	ZSTD_DDict *ddict;
+} ZstdDictionary;
+
+// unlike the contexts the table is shared by the threads, the entries are
+// copied out under the lock since the table moves when it grows. a digested
+// dictionary is never freed, so the copy stays valid.
+static pthread_mutex_t zstd_dictionaries_lock = PTHREAD_MUTEX_INITIALIZER;
+static ZstdDictionary *zstd_dictionaries = NULL;
+static size_t zstd_ndictionaries = 0;
+static int (*zstd_dictionary_loader)(uint32_t id) = NULL;
+
+void _zstd_dictionary_set_loader(int (*loader)(uint32_t id)) { zstd_dictionary_loader = loader; }
+
+uint32_t _zstd_dictionary_id(unsigned char *dict, size_t dict_sz) { return ZDICT_getDictID(dict, dict_sz); }
+
+// the caller holds the lock
+static ZstdDictionary *zstd_dictionary_lookup(uint32_t id)
+{
+	for (size_t i = 0; i < zstd_ndictionaries; ++i) {
+		if (zstd_dictionaries[i].id == id)
+			return &zstd_dictionaries[i];
+	}
+
+	return NULL;
+}
+
+static bool zstd_dictionary_get(uint32_t id, ZstdDictionary *entry)
+{
+	pthread_mutex_lock(&zstd_dictionaries_lock);
+	ZstdDictionary *d = zstd_dictionary_lookup(id);
+	if (d != NULL)
+		*entry = *d;
+	pthread_mutex_unlock(&zstd_dictionaries_lock);
+
+	return d != NULL;
+}
+
+// the dictionary is copied, loading a loaded dictionary does nothing
+int _zstd_dictionary_load(unsigned char *dict, size_t dict_sz)
+{
+	uint32_t id = ZDICT_getDictID(dict, dict_sz);
+	ZstdDictionary entry;
+	if (id == 0)
+		return -1;
+
+	if (zstd_dictionary_get(id, &entry))
+		return 0;
+
+	// digested outside of the lock, it is dropped if a concurrent load wins
+	entry = (ZstdDictionary){
+	    .id = id,
+	    .cdict = ZSTD_createCDict(dict, dict_sz, 0),
+	    .ddict = ZSTD_createDDict(dict, dict_sz),
+	};
+	if (entry.cdict == NULL || entry.ddict == NULL) {
+		ZSTD_freeCDict(entry.cdict);
+		ZSTD_freeDDict(entry.ddict);
+		return -1;
+	}
+
+	pthread_mutex_lock(&zstd_dictionaries_lock);
+	bool exists = zstd_dictionary_lookup(id) != NULL;
+	ZstdDictionary *dictionaries =
+	    exists ? NULL : realloc(zstd_dictionaries, (zstd_ndictionaries + 1) * sizeof(ZstdDictionary));
+	if (dictionaries != NULL) {
+		zstd_dictionaries = dictionaries;
+		zstd_dictionaries[zstd_ndictionaries++] = entry;
+	}
+	pthread_mutex_unlock(&zstd_dictionaries_lock);
+
+	if (dictionaries == NULL) {
+		ZSTD_freeCDict(entry.cdict);
+		ZSTD_freeDDict(entry.ddict);
+	}
+
+	return exists || dictionaries != NULL ? 0 : -1;
+}
+
+// find the dictionary, the loader is asked if it is not loaded yet
+static bool zstd_dictionary_find(uint32_t id, ZstdDictionary *entry)
+{
+	if (zstd_dictionary_get(id, entry))
+		return true;
+
+	return zstd_dictionary_loader != NULL && zstd_dictionary_loader(id) == 0 && zstd_dictionary_get(id, entry);
+}
+
+bool _zstd_dictionary_exists(uint32_t id)
+{
+	ZstdDictionary entry;
+	return zstd_dictionary_find(id, &entry);
+}
+
+// compress with the dictionary, 0 for no dictionary. the level of the stage is
+// used if there is no dictionary.
+static size_t zstd_compress(
+    unsigned char *output, size_t output_sz, unsigned char *input, size_t input_sz, uint32_t dictionary)
+{
+	if (zstd_cctx == NULL && (zstd_cctx = ZSTD_createCCtx()) == NULL)
+		return ZSTD_FAILED;
+
+	if (dictionary == 0 && zstd_stage == TE_STAGE_ZSTD_LONG) {
+		// long distance matching raises the window to 128MiB for huge values
+		ZSTD_CCtx_reset(zstd_cctx, ZSTD_reset_session_and_parameters);
+		ZSTD_CCtx_setParameter(zstd_cctx, ZSTD_c_compressionLevel, zstd_level);
+		ZSTD_CCtx_setParameter(zstd_cctx, ZSTD_c_enableLongDistanceMatching, 1);
+		return ZSTD_compress2(zstd_cctx, output, output_sz, input, input_sz);
+	}
+
+	if (dictionary == 0)
+		return ZSTD_compressCCtx(zstd_cctx, output, output_sz, input, input_sz, zstd_level);
+
+	ZstdDictionary d;
+	if (!zstd_dictionary_find(dictionary, &d))
+		return ZSTD_FAILED;
+
+	return ZSTD_compress_usingCDict(zstd_cctx, output, output_sz, input, input_sz, d.cdict);
+}
+
+// the dictionary of the frame, NULL if the frame has no dictionary. it is an
+// error if the dictionary can not be found.
+static int zstd_frame_dictionary(unsigned char *input, size_t input_sz, ZSTD_DDict **ddict)
+{
+	*ddict = NULL;
+
+	uint32_t id = ZSTD_getDictID_fromFrame(input, input_sz);
+	if (id == 0)
+		return 0;
+
+	ZstdDictionary d;
+	if (!zstd_dictionary_find(id, &d))
+		return -1;
+
+	*ddict = d.ddict;
+	return 0;
+}
+
+static size_t zstd_decompress(unsigned char *output, size_t output_sz, unsigned char *input, size_t input_sz)
+{
+	if (zstd_dctx == NULL && (zstd_dctx = ZSTD_createDCtx()) == NULL)
+		return ZSTD_FAILED;
+
+	ZSTD_DDict *ddict = NULL;
+	if (zstd_frame_dictionary(input, input_sz, &ddict) != 0)
+		return ZSTD_FAILED;
+
+	// the dictionary is always passed, the sticky one of the stream is ignored
+	return ZSTD_decompress_usingDDict(zstd_dctx, output, output_sz, input, input_sz, ddict);
+}
+
 int _zstd_encode(
     unsigned char *input, size_t input_sz,	  //
     unsigned char **output, size_t *output_sz,	  //
     void *(*realloc_func)(void *, size_t, size_t) //
 )
+{
+	return _zstd_encode_dict(input, input_sz, 0, output, output_sz, realloc_func);
+}
+
+int _zstd_encode_dict(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
 {
 	size_t dn = ZSTD_compressBound(input_sz);
 	unsigned char *d = realloc_func(NULL, 0, dn);
-	dn = ZSTD_compress(d, dn, input, input_sz, 0);
+	dn = zstd_compress(d, dn, input, input_sz, dictionary);
+	if (ZSTD_isError(dn))
+		return -1;
 
 	*output = d;
 	*output_sz = dn;
@@ -35,150 +257,364 @@ int _zstd_encode(
 	return 0;
 }
 
+// decompress the frames of unknown size, the output grows as needed. every
+// frame is decompressed with its own dictionary.
+static int zstd_decode_stream(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	size_t cap = *output_sz;
+	ZSTD_outBuffer out = {*output, cap, 0};
+	for (size_t offset = 0; offset < input_sz;) {
+		ZSTD_DDict *ddict = NULL;
+		size_t frame_sz = ZSTD_findFrameCompressedSize(input + offset, input_sz - offset);
+		if (ZSTD_isError(frame_sz) || zstd_frame_dictionary(input + offset, frame_sz, &ddict) != 0)
+			return -1;
+
+		ZSTD_DCtx_reset(zstd_dctx, ZSTD_reset_session_and_parameters);
+		ZSTD_DCtx_refDDict(zstd_dctx, ddict);
+
+		size_t ret = 1;
+		ZSTD_inBuffer in = {input + offset, frame_sz, 0};
+		while (in.pos < in.size || (ret != 0 && out.pos == out.size)) {
+			if (out.pos == out.size) {
+				size_t new_cap = cap < ZSTD_DStreamOutSize() ? ZSTD_DStreamOutSize() : cap * 2;
+				*output = realloc_func(*output, cap, new_cap);
+				out.dst = *output, out.size = cap = new_cap;
+			}
+
+			ret = ZSTD_decompressStream(zstd_dctx, &out, &in);
+			if (ZSTD_isError(ret))
+				return -1;
+
+			if (ret != 0 && in.pos == in.size && out.pos < out.size)
+				return -1; // truncated frame
+		}
+
+		offset += frame_sz;
+	}
+
+	*output_sz = out.pos;
+	return 0;
+}
+
+// the output is reused if it is large enough, one or more frames are
+// decompressed to it directly.
 int _zstd_decode(
     unsigned char *input, size_t input_sz,	  //
     unsigned char **output, size_t *output_sz,	  //
     void *(*realloc_func)(void *, size_t, size_t) //
 )
 {
-	int dn = ZSTD_getFrameContentSize(input, input_sz);
-	unsigned char *d = alloca(dn);
-	dn = ZSTD_decompress(d, dn, input, input_sz);
-	if (dn < 0) {
-		const char *e = ZSTD_getErrorName(dn);
-		printf("%s\n", e);
+	if (zstd_dctx == NULL && (zstd_dctx = ZSTD_createDCtx()) == NULL)
+		return -1;
+
+	// the sum of the content size of all frames
+	unsigned long long dn = 0;
+	for (size_t offset = 0; offset < input_sz;) {
+		unsigned long long n = ZSTD_getFrameContentSize(input + offset, input_sz - offset);
+		size_t frame_sz = ZSTD_findFrameCompressedSize(input + offset, input_sz - offset);
+		if (n == ZSTD_CONTENTSIZE_ERROR || ZSTD_isError(frame_sz))
+			return -1;
+
+		if (n == ZSTD_CONTENTSIZE_UNKNOWN)
+			return zstd_decode_stream(input, input_sz, output, output_sz, realloc_func);
+
+		dn += n, offset += frame_sz;
 	}
 
-	if (*output_sz < dn) {
+	if (*output == NULL || *output_sz < dn) {
 		*output = realloc_func(*output, *output_sz, dn);
 	}
 
-	memcpy((*output), d, dn);
+	// the frames are decompressed one by one, each with its own dictionary
+	for (size_t offset = 0, pos = 0; offset < input_sz;) {
+		size_t frame_sz = ZSTD_findFrameCompressedSize(input + offset, input_sz - offset);
+		unsigned long long n = ZSTD_getFrameContentSize(input + offset, input_sz - offset);
+		if (zstd_decompress(*output + pos, n, input + offset, frame_sz) != n)
+			return -1;
+
+		offset += frame_sz, pos += n;
+	}
+
 	*output_sz = dn;
 	return 0;
 }
 
+// the value is compressed by the second stage, and copied as is if zstd does
+// not pay. the output is a zstd frame only if it is compressed.
+int _zstd_encode_adaptive(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	if (zstd_stage == TE_STAGE_NONE) {
+		*output = realloc_func(NULL, 0, input_sz);
+	} else {
+		size_t bound = ZSTD_compressBound(input_sz);
+		if (_zstd_encode_dict(input, input_sz, dictionary, output, output_sz, realloc_func) != 0)
+			return -1;
+
+		// the room of the bound is given back, the caller keeps the output as it is
+		if (zstd_pays(input_sz, *output_sz)) {
+			*output = realloc_func(*output, bound, *output_sz);
+			return 0;
+		}
+	}
+
+	// the output of zstd is larger than the input, it is reused
+	memcpy(*output, input, input_sz);
+	*output_sz = input_sz;
+	return 0;
+}
+
+// the input is returned as is if it is not compressed
+int _zstd_decode_adaptive(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	if (zstd_is_frame(input, input_sz))
+		return _zstd_decode(input, input_sz, output, output_sz, realloc_func);
+
+	*output = input, *output_sz = input_sz;
+	return 0;
+}
+
+// bits are stored MSB first. the writer collects bits in a 64bit register and
+// stores a whole big-endian word once the register is full, the reader loads
+// an unaligned word at the current byte and shifts out the consumed bits.
 typedef struct BitStream {
 	uint8_t *buffer;
 	size_t buffer_size;
-	size_t buffer_offset_current;
+	size_t buffer_offset_current; // writer: bytes stored. reader: bits consumed
 
-	uint8_t bits_current;
-	uint8_t bits_current_remaining; // (0, 8]
+	uint64_t bits_current;		// writer: pending bits, aligned to the MSB
+	uint8_t bits_current_remaining; // writer: free bits in bits_current (0, 64]
 } BitStream;
 
-static BitStream
-bitstream_create(void *source, size_t size, size_t offset, void *(*realloc_func)(void *, size_t, size_t))
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#	define bitstream_be64(x) __builtin_bswap64(x)
+#else
+#	define bitstream_be64(x) (x)
+#endif
+
+#define bitstream_mask(n) ((n) >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << (n)) - 1)
+
+static BitStream bitstream_create(void *source, size_t size, size_t offset)
 {
 	return (BitStream){
 	    .buffer = source,
 	    .buffer_size = size,
 	    .buffer_offset_current = offset,
 	    .bits_current = 0,
-	    .bits_current_remaining = 8,
+	    .bits_current_remaining = 64,
 	};
 }
 
+static inline void bitstream_store_word(BitStream *bs, uint64_t word)
+{
+	word = bitstream_be64(word);
+	memcpy(bs->buffer + bs->buffer_offset_current, &word, 8);
+	bs->buffer_offset_current += 8;
+}
+
+// write the pending bits after the stored words, the last byte is padding
+// with 0. returns the bytes written, the writer state is not changed.
+static uint8_t bitstream_write_pending(BitStream *bs)
+{
+	uint8_t n = (64 - bs->bits_current_remaining + 7) / 8;
+	uint64_t word = bitstream_be64(bs->bits_current);
+	memcpy(bs->buffer + bs->buffer_offset_current, &word, n);
+	return n;
+}
+
+// write out the pending bits, the last byte is padding with 0
 static void bitstream_flush(BitStream *bs)
 {
-	if (bs->bits_current_remaining == 8)
+	if (bs->bits_current_remaining == 64)
 		return;
 
-	if (bs->buffer_size <= bs->buffer_offset_current) {
-		// ERROR!
-	}
-
-	bs->buffer[bs->buffer_offset_current++] = bs->bits_current;
-	bs->bits_current = 0, bs->bits_current_remaining = 8;
+	bs->buffer_offset_current += bitstream_write_pending(bs);
+	bs->bits_current = 0, bs->bits_current_remaining = 64;
 }
 
-static void bitstream_write_bit_n(BitStream *bs, uint8_t bits, uint8_t n)
+// write the low n bits of `bits`, n in [0, 64]
+static inline void bitstream_write_bit_n(BitStream *bs, uint64_t bits, uint8_t n)
 {
-	if (bs->bits_current_remaining >= n) { // can write to bs->current_value
-		bs->bits_current_remaining -= n;
-		bs->bits_current |= (bits & ((1 << n) - 1)) << bs->bits_current_remaining;
+	if (n == 0)
+		return;
 
-		if (bs->bits_current_remaining == 0) {
-			bitstream_flush(bs);
-		}
+	bits &= bitstream_mask(n);
 
+	if (bs->bits_current_remaining > n) { // can write to bs->bits_current
+		bs->bits_current_remaining -= n;
+		bs->bits_current |= bits << bs->bits_current_remaining;
 		return;
 	}
 
-	// can not write to bs->current_value, split to 2 parts
-	uint8_t part = n - bs->bits_current_remaining;
-	uint8_t b1 = bits >> part;	 // save to bs->buffer[bs->buffer_size]
-	uint8_t b2 = bits << (8 - part); // save to bs->current_value
+	// the register is full, split to 2 parts
+	uint8_t part = n - bs->bits_current_remaining; // [0, 64)
+	bs->bits_current |= bits >> part;
+	bitstream_store_word(bs, bs->bits_current);
+
+	bs->bits_current = part == 0 ? 0 : bits << (64 - part);
+	bs->bits_current_remaining = 64 - part;
+}
 
-	bs->bits_current |= b1;
-	bitstream_flush(bs);
+// the value is stored as little-endian bytes, the last byte only keep n%8 bits.
+// reorder it to a MSB first code word so it can be write out in one step.
+static inline uint64_t bitstream_value_to_code(uint64_t v, uint8_t n)
+{
+	uint8_t full = n / 8 * 8, rest = n % 8;
+	uint64_t code = (v >> full) & bitstream_mask(rest);
+	if (full != 0)
+		code |= (bitstream_be64(v) >> (64 - full)) << rest;
 
-	bs->bits_current = b2;
-	bs->bits_current_remaining -= part;
+	return code;
 }
 
-static void bitstream_write_64_n(BitStream *bs, uint64_t bits, uint8_t n)
+static inline uint64_t bitstream_code_to_value(uint64_t code, uint8_t n)
 {
-	for (uint8_t i = 0; i < 8; ++i) {
-		uint8_t off = (uint8_t[]){0, 8, 16, 24, 32, 40, 48, 56}[i];
+	uint8_t full = n / 8 * 8, rest = n % 8;
+	uint64_t v = (code & bitstream_mask(rest)) << full;
+	if (full != 0)
+		v |= bitstream_be64((code >> rest) << (64 - full));
 
-		if (n < off)
-			break;
+	return v;
+}
 
-		uint8_t part = n - off;
-		bitstream_write_bit_n(bs, (uint8_t)(bits >> off), part > 8 ? 8 : part);
-	}
+static inline void bitstream_write_64_n(BitStream *bs, uint64_t bits, uint8_t n)
+{
+	bitstream_write_bit_n(bs, bitstream_value_to_code(bits, n), n);
 }
 
-static inline uint8_t bitstream_read_bit_incurrent_value_n(BitStream *bs, unsigned char n)
+// 64 bits start at the current reading position, at least 57 bits are valid.
+// bytes after the end of buffer are read as 0.
+static inline uint64_t bitstream_peek_word(BitStream *bs)
 {
-	bs->bits_current_remaining -= n;
-	return (bs->buffer[bs->buffer_offset_current] >> bs->bits_current_remaining) & ((1 << n) - 1);
+	size_t offset = bs->buffer_offset_current / 8;
+	uint64_t word = 0;
+
+	if (offset + 8 <= bs->buffer_size)
+		memcpy(&word, bs->buffer + offset, 8);
+	else if (offset < bs->buffer_size)
+		memcpy(&word, bs->buffer + offset, bs->buffer_size - offset);
+
+	return bitstream_be64(word) << (bs->buffer_offset_current % 8);
 }
 
-static uint8_t bitstream_read_bit_n(BitStream *bs, unsigned char n)
+// read n bits, n in [0, 57]
+static inline uint64_t bitstream_read_bit_n(BitStream *bs, uint8_t n)
 {
 	if (n == 0)
 		return 0;
 
-	uint8_t ret = 0;
+	uint64_t ret = bitstream_peek_word(bs) >> (64 - n);
+	bs->buffer_offset_current += n;
+	return ret;
+}
 
-	if (bs->bits_current_remaining >= n) { // read from bs->current_value
-		ret = bitstream_read_bit_incurrent_value_n(bs, n);
+// read n bits, n in [0, 64]
+static inline uint64_t bitstream_read_long_n(BitStream *bs, uint8_t n)
+{
+	if (n <= 57)
+		return bitstream_read_bit_n(bs, n);
 
-		if (bs->bits_current_remaining == 0) {
-			bs->bits_current_remaining = 8;
-			bs->buffer_offset_current++;
-		}
+	uint64_t ret = bitstream_read_bit_n(bs, 32) << (n - 32);
+	return ret | bitstream_read_bit_n(bs, n - 32);
+}
 
-		return ret;
+static inline uint64_t bitstream_read_64_n(BitStream *bs, uint8_t n)
+{
+	uint64_t code = 0;
+	if (n > 32) {
+		code = bitstream_read_bit_n(bs, 32) << (n - 32);
+		code |= bitstream_read_bit_n(bs, n - 32);
+	} else {
+		code = bitstream_read_bit_n(bs, n);
 	}
 
-	// bs->current_value dose not have enough bits to read. split the reading
-	uint8_t part = n - bs->bits_current_remaining;
-	ret = bitstream_read_bit_incurrent_value_n(bs, bs->bits_current_remaining) << part;
-	bs->buffer_offset_current++;
-	bs->bits_current_remaining = 8;
-	ret |= bitstream_read_bit_incurrent_value_n(bs, part);
+	return bitstream_code_to_value(code, n);
+}
 
-	return ret;
+// rebuild the values from the delta of delta in place. for each i in [0, n):
+//   delta += v[i], last += delta, v[i] = last
+//
+// it is a prefix sum of a prefix sum, the simd version does the two scans in
+// the register and carry the last lane to the next round.
+static void prefix_sum2_scalar(uint64_t *v, size_t n, uint64_t delta, uint64_t last)
+{
+	for (size_t i = 0; i < n; ++i) {
+		delta += v[i];
+		last += delta;
+		v[i] = last;
+	}
 }
 
-static inline uint64_t bitstream_read_64_n(BitStream *bs, uint8_t n)
+#if defined(__x86_64__)
+static void prefix_sum2_sse2(uint64_t *v, size_t n, uint64_t delta, uint64_t last)
+{
+	__m128i d = _mm_set1_epi64x(delta), l = _mm_set1_epi64x(last);
+
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2) {
+		__m128i x = _mm_loadu_si128((__m128i *)(v + i));
+		x = _mm_add_epi64(x, _mm_slli_si128(x, 8));
+		x = _mm_add_epi64(x, d);
+		d = _mm_unpackhi_epi64(x, x);
+
+		x = _mm_add_epi64(x, _mm_slli_si128(x, 8));
+		x = _mm_add_epi64(x, l);
+		l = _mm_unpackhi_epi64(x, x);
+		_mm_storeu_si128((__m128i *)(v + i), x);
+	}
+
+	prefix_sum2_scalar(v + i, n - i, _mm_cvtsi128_si64(d), _mm_cvtsi128_si64(l));
+}
+
+__attribute__((target("avx2"))) static inline __m256i prefix_sum_avx2_4(__m256i x)
 {
-	uint64_t ret = 0;
+	x = _mm256_add_epi64(x, _mm256_slli_si256(x, 8)); // [a, a+b, c, c+d]
+	__m256i lo = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(1, 1, 1, 1));
+	return _mm256_add_epi64(x, _mm256_blend_epi32(_mm256_setzero_si256(), lo, 0xF0));
+}
 
-	for (uint8_t i = 0; i < 8; ++i) {
-		uint8_t off = (const uint8_t[]){0, 8, 16, 24, 32, 40, 48, 56}[i];
+__attribute__((target("avx2"))) static void prefix_sum2_avx2(uint64_t *v, size_t n, uint64_t delta, uint64_t last)
+{
+	__m256i d = _mm256_set1_epi64x(delta), l = _mm256_set1_epi64x(last);
 
-		if (n < off)
-			break;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i x = _mm256_loadu_si256((__m256i *)(v + i));
+		x = _mm256_add_epi64(prefix_sum_avx2_4(x), d);
+		d = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 3, 3, 3));
 
-		uint8_t part = n - off;
-		ret |= (uint64_t)bitstream_read_bit_n(bs, part > 8 ? 8 : part) << off;
+		x = _mm256_add_epi64(prefix_sum_avx2_4(x), l);
+		l = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 3, 3, 3));
+		_mm256_storeu_si256((__m256i *)(v + i), x);
 	}
 
-	return ret;
+	prefix_sum2_scalar(
+	    v + i, n - i, _mm_cvtsi128_si64(_mm256_castsi256_si128(d)), _mm_cvtsi128_si64(_mm256_castsi256_si128(l)));
+}
+#endif
+
+static void prefix_sum2(uint64_t *v, size_t n, uint64_t delta, uint64_t last)
+{
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("avx2"))
+		return prefix_sum2_avx2(v, n, delta, last);
+
+	return prefix_sum2_sse2(v, n, delta, last);
+#else
+	return prefix_sum2_scalar(v, n, delta, last);
+#endif
 }
 
 // the delta of delta encoded for int datatype
@@ -197,99 +633,127 @@ static inline uint64_t bitstream_read_64_n(BitStream *bs, uint8_t n)
 //     0b1110   = delta of delta w (-2047, 2048)             . value size = 12
 //     0b11110  = delta of delta w (i32 min, i32 max)        . value size = 32
 //     0b111110 = delta of delta w (i64 min, i64 max)        . value size = 64
-int _u8_encode(
-    uint64_t *input, size_t input_sz,		  //
-    unsigned char **output, size_t *output_sz,	  //
-    void *(*realloc_func)(void *, size_t, size_t) //
-)
+//
+// the first value and delta are 0 when there are less than 2 values.
+
+#define U8_HEADER_MAX_SZ (1 + 3 + 8 + 8)
+
+// the size of header, count, first value and first delta. -1 if the count will overflow
+static int u8_header_size(size_t count)
+{
+	if (count > 0xFFFFFF)
+		return -1;
+	else if (count > 0x00FFFF)
+		return 1 + 3 + 8 + 8;
+	else if (count > 0x0000FF)
+		return 1 + 2 + 8 + 8;
+	else
+		return 1 + 1 + 8 + 8;
+}
+
+static void u8_write_header(unsigned char *output, uint32_t count, uint64_t first, int64_t delta)
 {
 	// encoding type = uint64_t
 	uint8_t header = TE_VER | TE_DI8;
 
-	// set output size
 	uint8_t output_len_size = 0;
-	if (input_sz > 0xFFFFFF)
-		return -1; // will overflow
-	else if (input_sz > 0x00FFFF)
+	if (count > 0x00FFFF)
 		header |= TE_SZ3, output_len_size = 3;
-	else if (input_sz > 0x0000FF)
+	else if (count > 0x0000FF)
 		header |= TE_SZ2, output_len_size = 2;
 	else
 		header |= TE_SZ1, output_len_size = 1;
 
-	// alloc memory
-	*output_sz = 1 /* header */ + output_len_size /* length */ + input_sz * 8 * 1.2 /* value */;
-	*output = realloc_func(NULL, 0, *output_sz);
-	unsigned char *output_buffer = *output;
-
 	// write the header out
-	output_buffer[0] = header;
-	output_buffer += 1;
+	output[0] = header;
+	output += 1;
 
 	// write out the input count
-	uint32_t input_entity_size = input_sz;
-	memcpy(output_buffer, &input_entity_size, output_len_size);
-	output_buffer += output_len_size;
+	memcpy(output, &count, output_len_size);
+	output += output_len_size;
 
 	// write out the first value
-	memcpy(output_buffer, input, 8);
-	output_buffer += 8;
+	memcpy(output, &first, 8);
+	output += 8;
 
 	// write the first delta value out (v1 - v0).
-	__int128 delta = input[1] - input[0];
-	int64_t dod = (int64_t)delta;
-	memcpy(output_buffer, &dod, 8);
-	output_buffer += 8;
+	memcpy(output, &delta, 8);
+}
+
+// write out one delta of delta, 70 bits at most
+static inline void u8_write_double_delta(BitStream *bs, int64_t double_delta)
+{
+	uint8_t control = 0, control_len = 0, value_len_without_sign = 0;
+	if (double_delta == 0)
+		control = 0b0, control_len = 1, value_len_without_sign = 0;
+	else if (-63 < double_delta && double_delta < 64)
+		control = 0b10, control_len = 2, value_len_without_sign = 6;
+	else if (-255 < double_delta && double_delta < 256)
+		control = 0b110, control_len = 3, value_len_without_sign = 8;
+	else if (-2047 < double_delta && double_delta < 2048)
+		control = 0b1110, control_len = 4, value_len_without_sign = 11;
+	else if (INT32_MIN < double_delta && double_delta < INT32_MAX)
+		control = 0b11110, control_len = 5, value_len_without_sign = 31;
+	else
+		control = 0b111110, control_len = 6, value_len_without_sign = 63;
+
+	uint8_t sign = double_delta < 0;
+	double_delta = llabs(double_delta);
+
+	if (value_len_without_sign == 0) {
+		bitstream_write_bit_n(bs, control, control_len);
+		return;
+	}
+
+	bitstream_write_bit_n(bs, control << 1 | sign, control_len + 1);
+	bitstream_write_64_n(bs, double_delta, value_len_without_sign);
+}
+
+int _u8_encode(
+    uint64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	int header_sz = u8_header_size(input_sz);
+	if (header_sz < 0)
+		return -1; // will overflow
+
+	// alloc memory
+	*output_sz = header_sz + input_sz * 8 * 1.2 /* value */;
+	*output = realloc_func(NULL, 0, *output_sz);
+
+	uint64_t first = input_sz > 0 ? input[0] : 0;
+	int64_t delta = input_sz > 1 ? input[1] - input[0] : 0;
+	u8_write_header(*output, input_sz, first, delta);
 
 	// structure the output bitstream
-	BitStream bs = bitstream_create(output_buffer, output_buffer - *output, 0, realloc_func);
-	for (size_t i = 2; i < input_entity_size; ++i) {
+	BitStream bs = bitstream_create(*output + header_sz, *output_sz - header_sz, 0);
+	for (size_t i = 2; i < input_sz; ++i) {
 		// double_delta = (v[i] - v[i-1]) - (v[i-1] - v[i-2])
 		//              = v[i] -2*v[i-1] + v[i-2]
 		int64_t double_delta = input[i] - 2 * input[i - 1] + input[i - 2];
-
-		uint8_t control = 0, control_len = 0, value_len_without_sign = 0;
-		if (double_delta == 0)
-			control = 0b0, control_len = 1, value_len_without_sign = 0;
-		else if (-63 < double_delta && double_delta < 64)
-			control = 0b10, control_len = 2, value_len_without_sign = 6;
-		else if (-255 < double_delta && double_delta < 256)
-			control = 0b110, control_len = 3, value_len_without_sign = 8;
-		else if (-2047 < double_delta && double_delta < 2048)
-			control = 0b1110, control_len = 4, value_len_without_sign = 11;
-		else if (INT32_MIN < double_delta && double_delta < INT32_MAX)
-			control = 0b11110, control_len = 5, value_len_without_sign = 31;
-		else
-			control = 0b111110, control_len = 6, value_len_without_sign = 63;
-
-		uint8_t sign = double_delta < 0;
-		double_delta = llabs(double_delta);
-
-		bitstream_write_bit_n(&bs, control, control_len);
-		if (value_len_without_sign != 0) {
-			bitstream_write_bit_n(&bs, sign, 1);
-			bitstream_write_64_n(&bs, double_delta, value_len_without_sign);
-		}
+		u8_write_double_delta(&bs, double_delta);
 	}
 
 	bitstream_flush(&bs);
-	*output_sz = bs.buffer_offset_current + 1 + output_len_size + 8 + 8;
+	*output_sz = bs.buffer_offset_current + header_sz;
 	return 0;
 }
 
-int _u8_decode(
-    unsigned char *input, size_t input_sz,	  //
-    uint64_t **output, size_t *output_sz,	  //
-    void *(*realloc_func)(void *, size_t, size_t) //
-)
+// parse the header and the count. returns the size of them, -1 if the input is
+// not the payload type or truncated
+static int header_read(unsigned char *input, size_t input_sz, uint8_t version, uint8_t type, uint32_t *count)
 {
+	if (input_sz < 1)
+		return -1;
+
 	uint8_t header = input[0];
-	input += 1;
 
-	if ((header & TE_VER_MASK) != TE_VER)
+	if ((header & TE_VER_MASK) != version)
 		return -1;
 
-	if ((header & TE___D_MASK) != TE_DI8) {
+	if ((header & TE___D_MASK) != type) {
 		return -1;
 	}
 
@@ -308,68 +772,2986 @@ int _u8_decode(
 		return -1;
 	}
 
-	uint32_t output_entity_num = 0;
-	memcpy(&output_entity_num, input, encode_sz_len);
-	input += encode_sz_len;
+	if (input_sz < 1 + (size_t)encode_sz_len)
+		return -1;
 
-	// alloc memcpy
-	*output_sz = output_entity_num * 8;
-	*output = realloc_func(NULL, 0, *output_sz);
+	*count = 0;
+	memcpy(count, input + 1, encode_sz_len);
+	return 1 + encode_sz_len;
+}
 
-	// the first value
-	int64_t last = ((int64_t *)input)[0];
-	input += 8;
-	(*output)[0] = last;
+// LEB128 varint, 10 bytes at most
+static inline uint8_t varint_size(uint64_t v) { return v == 0 ? 1 : (64 - __builtin_clzll(v) + 6) / 7; }
 
-	// the second value
-	int64_t delta = ((int64_t *)input)[0];
-	input += 8;
-	last = last + delta;
-	(*output)[1] = last;
+static inline size_t varint_write(unsigned char *output, uint64_t v)
+{
+	size_t n = 0;
+	for (; v >= 0x80; v >>= 7)
+		output[n++] = v | 0x80;
 
-	BitStream bs = bitstream_create(input, input_sz - 1 - encode_sz_len - 2 * 8, 0, NULL);
-	for (size_t i = 2; i < output_entity_num; ++i) {
-		for (uint8_t value_size_index = 0; value_size_index < 6; ++value_size_index) {
+	output[n++] = v;
+	return n;
+}
 
-			uint8_t control = bitstream_read_bit_n(&bs, 1);
-			if ((control & 0b01) == 0b01) // control bit not 0b, get next value size
-				continue;
+// returns the bytes read, 0 if the input is truncated or the varint is too long
+static inline size_t varint_read(unsigned char *input, size_t input_sz, uint64_t *v)
+{
+	*v = 0;
+	for (size_t n = 0; n < input_sz && n < 10; ++n) {
+		*v |= (uint64_t)(input[n] & 0x7F) << (7 * n);
+		if ((input[n] & 0x80) == 0)
+			return n + 1;
+	}
+
+	return 0;
+}
 
-			const uint8_t value_size = (uint8_t[]){0, 6, 8, 11, 31, 63}[value_size_index];
+static inline uint64_t zigzag_encode(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
 
-			int64_t sign = 0, double_delta = 0;
-			if (value_size != 0) {
-				sign = bitstream_read_bit_n(&bs, 1);
-				double_delta = bitstream_read_64_n(&bs, value_size);
+static inline int64_t zigzag_decode(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
 
-				double_delta *= (sign != 0) ? -1 : 1;
-				delta += double_delta;
-			}
+// the frame of TE_PFR: 128 zigzag deltas packed in a fixed width. the value i
+// is in the lane i%4, each lane is a LSB first stream of 32bit words and the
+// word j of the 4 lanes are together, so one load gets the same word of every
+// lane and a simd register decodes 4 values at once.
+#define PFR_FRAME 128
 
-			last += delta;
-			(*output)[i] = last;
+static inline uint32_t pfr_word(const unsigned char *packed, size_t j, int lane)
+{
+	uint32_t w;
+	memcpy(&w, packed + (j * 4 + lane) * 4, 4);
+	return w;
+}
 
-			break;
+// pack the low width bits of the 128 values to 16*width bytes
+static void pfr_pack_scalar(unsigned char *packed, const uint64_t *v, uint8_t width)
+{
+	for (int lane = 0; lane < 4; ++lane) {
+		uint64_t acc = 0;
+		size_t j = 0;
+		int fill = 0;
+		for (int k = 0; k < PFR_FRAME / 4; ++k) {
+			uint64_t x = v[k * 4 + lane];
+			for (int n = width; n > 0; n -= 32, x >>= 32) { // the wide values in 2 parts
+				int take = n < 32 ? n : 32;
+				acc |= (x & bitstream_mask(take)) << fill;
+				fill += take;
+				if (fill >= 32) {
+					uint32_t w = acc;
+					memcpy(packed + (j++ * 4 + lane) * 4, &w, 4);
+					acc >>= 32, fill -= 32;
+				}
+			}
 		}
 	}
+}
 
+static void pfr_unpack_scalar(uint64_t *v, const unsigned char *packed, uint8_t width)
+{
+	for (int lane = 0; lane < 4; ++lane) {
+		uint64_t acc = 0;
+		size_t j = 0;
+		int fill = 0;
+		for (int k = 0; k < PFR_FRAME / 4; ++k) {
+			uint64_t x = 0;
+			for (int n = width, shift = 0; n > 0; n -= 32, shift += 32) {
+				int take = n < 32 ? n : 32;
+				if (fill < take)
+					acc |= (uint64_t)pfr_word(packed, j++, lane) << fill, fill += 32;
+
+				x |= (acc & bitstream_mask(take)) << shift;
+				acc >>= take, fill -= take;
+			}
+			v[k * 4 + lane] = x;
+		}
+	}
+}
+
+// zigzag decode the deltas and add them up from last, returns the last value
+static uint64_t pfr_prefix_sum_scalar(uint64_t *v, size_t n, uint64_t last)
+{
+	for (size_t i = 0; i < n; ++i)
+		v[i] = last += zigzag_decode(v[i]);
+
+	return last;
+}
+
+#if defined(__x86_64__)
+// the simd kernels handle widths up to 32, a value is always in a 64bit window
+// of 2 words. wider deltas are random data and use the scalar code.
+__attribute__((target("avx2"))) static void pfr_pack_avx2(unsigned char *packed, const uint64_t *v, uint8_t width)
+{
+	__m256i mask = _mm256_set1_epi64x(bitstream_mask(width)), acc = _mm256_setzero_si256();
+	__m256i low32 = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+
+	int fill = 0;
+	for (int k = 0; k < PFR_FRAME / 4; ++k) {
+		__m256i x = _mm256_and_si256(_mm256_loadu_si256((__m256i *)(v + k * 4)), mask);
+		acc = _mm256_or_si256(acc, _mm256_sll_epi64(x, _mm_cvtsi32_si128(fill)));
+		fill += width;
+		if (fill >= 32) {
+			__m128i w = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(acc, low32));
+			_mm_storeu_si128((__m128i *)packed, w);
+			packed += 16, acc = _mm256_srli_epi64(acc, 32), fill -= 32;
+		}
+	}
+}
+
+__attribute__((target("avx2"))) static void pfr_unpack_avx2(uint64_t *v, const unsigned char *packed, uint8_t width)
+{
+	__m256i mask = _mm256_set1_epi64x(bitstream_mask(width)), acc = _mm256_setzero_si256();
+	__m128i shift = _mm_cvtsi32_si128(width);
+
+	int fill = 0;
+	for (int k = 0; k < PFR_FRAME / 4; ++k) {
+		if (fill < width) {
+			__m256i w = _mm256_cvtepu32_epi64(_mm_loadu_si128((__m128i *)packed));
+			acc = _mm256_or_si256(acc, _mm256_sll_epi64(w, _mm_cvtsi32_si128(fill)));
+			packed += 16, fill += 32;
+		}
+
+		_mm256_storeu_si256((__m256i *)(v + k * 4), _mm256_and_si256(acc, mask));
+		acc = _mm256_srl_epi64(acc, shift), fill -= width;
+	}
+}
+
+__attribute__((target("avx2"))) static uint64_t pfr_prefix_sum_avx2(uint64_t *v, size_t n, uint64_t last)
+{
+	__m256i l = _mm256_set1_epi64x(last), one = _mm256_set1_epi64x(1), zero = _mm256_setzero_si256();
+
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i x = _mm256_loadu_si256((__m256i *)(v + i));
+		x = _mm256_xor_si256(_mm256_srli_epi64(x, 1), _mm256_sub_epi64(zero, _mm256_and_si256(x, one)));
+		x = _mm256_add_epi64(prefix_sum_avx2_4(x), l);
+		l = _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 3, 3, 3));
+		_mm256_storeu_si256((__m256i *)(v + i), x);
+	}
+
+	return pfr_prefix_sum_scalar(v + i, n - i, _mm_cvtsi128_si64(_mm256_castsi256_si128(l)));
+}
+#endif
+
+static void pfr_pack(unsigned char *packed, const uint64_t *v, uint8_t width)
+{
+#if defined(__x86_64__)
+	if (width <= 32 && __builtin_cpu_supports("avx2"))
+		return pfr_pack_avx2(packed, v, width);
+#endif
+	return pfr_pack_scalar(packed, v, width);
+}
+
+static void pfr_unpack(uint64_t *v, const unsigned char *packed, uint8_t width)
+{
+#if defined(__x86_64__)
+	if (width <= 32 && __builtin_cpu_supports("avx2"))
+		return pfr_unpack_avx2(v, packed, width);
+#endif
+	return pfr_unpack_scalar(v, packed, width);
+}
+
+static uint64_t pfr_prefix_sum(uint64_t *v, size_t n, uint64_t last)
+{
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("avx2"))
+		return pfr_prefix_sum_avx2(v, n, last);
+#endif
+	return pfr_prefix_sum_scalar(v, n, last);
+}
+
+// unpack n delta of delta to the output
+static void u8_read_double_deltas(BitStream *bs, uint64_t *double_deltas, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t word = bitstream_peek_word(bs);
+
+		// a run of 0b, the delta of delta is not changed
+		if ((word >> 63) == 0) {
+			size_t run = __builtin_clzll(word | (1ULL << 7)); // at most 56 bits are valid
+			run = run < n - i ? run : n - i;
+			memset(double_deltas + i, 0, run * 8);
+			bs->buffer_offset_current += run;
+			i += run - 1;
+			continue;
+		}
+
+		// the count of leading 1 is the index of value size, 0b111110 is the longest control
+		uint8_t value_size_index = __builtin_clzll(~word | (1ULL << 58));
+		const uint8_t value_size = (const uint8_t[]){0, 6, 8, 11, 31, 63}[value_size_index];
+
+		uint8_t control_len = value_size_index + 1;
+		uint64_t sign = (word >> (63 - control_len)) & 1, code = 0;
+		if (value_size != 63) { // control + sign + value <= 37 bits, all in the word
+			code = (word << (control_len + 1)) >> (64 - value_size);
+			bs->buffer_offset_current += control_len + 1 + value_size;
+		} else {
+			bs->buffer_offset_current += control_len + 1;
+			code = bitstream_read_bit_n(bs, 32) << 31;
+			code |= bitstream_read_bit_n(bs, 31);
+		}
+
+		uint64_t double_delta = bitstream_code_to_value(code, value_size);
+		double_deltas[i] = (double_delta ^ -sign) + sign;
+	}
+}
+
+// reads one block, values are decoded in batches of the caller's size. the
+// format without blocks is a single block of delta of delta.
+typedef struct U8BlockReader {
+	uint8_t type;		  // the codec of the block
+	uint32_t count, position; // the number of values, the number of values read
+	uint64_t last;		  // the last value read, the first value before reading. TE_PFR: the last value of the frame
+	int64_t delta;		  // TE_DI8: the last delta read. TE_LIN, TE_REG: the delta. TE_FOR: the reference
+	uint32_t run;		  // TE_RLE, TE_REG: the values left in the current run
+	uint8_t width;		  // TE_FOR: the bits of a packed delta
+	BitStream bs;		  // TE_RLE, TE_REG, TE_PFR: buffer_offset_current is the bytes read
+
+	// TE_PFR: the frame decoded for a read smaller than a frame
+	uint64_t frame[PFR_FRAME];
+	uint8_t frame_position, frame_count;
+} U8BlockReader;
+
+// the reader of the format without blocks
+static int u8_block_reader_init(U8BlockReader *r, unsigned char *input, size_t input_sz)
+{
+	uint32_t count = 0;
+	int header_sz = header_read(input, input_sz, TE_VER, TE_DI8, &count);
+	if (header_sz < 0 || input_sz < (size_t)header_sz + 8 + 8)
+		return -1;
+
+	uint64_t first = 0;
+	int64_t delta = 0;
+	memcpy(&first, input + header_sz, 8);
+	memcpy(&delta, input + header_sz + 8, 8);
+
+	unsigned char *bitstream = input + header_sz + 8 + 8;
+	*r = (U8BlockReader){
+	    .type = TE_DI8,
+	    .count = count,
+	    .last = first,
+	    .delta = delta,
+	    .bs = bitstream_create(bitstream, input_sz - (bitstream - input), 0),
+	};
+	return 0;
+}
+
+static size_t u8_block_read_dod(U8BlockReader *r, uint64_t *output, size_t n)
+{
+	// the first value and the second value are in the header
+	size_t i = 0;
+	for (; i < n && r->position < 2; ++i, ++r->position) {
+		if (r->position == 1)
+			r->last += r->delta;
+
+		output[i] = r->last;
+	}
+
+	if (i == n)
+		return n;
+
+	// phase 1: unpack all the delta of delta to the output buffer
+	u8_read_double_deltas(&r->bs, output + i, n - i);
+
+	// phase 2: rebuild the value from the delta of delta
+	prefix_sum2(output + i, n - i, r->delta, r->last);
+
+	uint64_t prev = n - i >= 2 ? output[n - 2] : r->last;
+	r->last = output[n - 1];
+	r->delta = r->last - prev;
+	r->position += n - i;
+	return n;
+}
+
+static size_t u8_block_read_lin(U8BlockReader *r, uint64_t *output, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		output[i] = r->last + (uint64_t)(r->position + i) * r->delta;
+
+	r->position += n;
+	return n;
+}
+
+// TE_RLE is TE_REG with a period of 0, the values of a run are filled with the
+// period from the offset of the run
+static size_t u8_block_read_rle(U8BlockReader *r, uint64_t *output, size_t n)
+{
+	size_t i = 0;
+	while (i < n) {
+		if (r->run == 0) {
+			uint64_t value_delta = 0, run = 0;
+			unsigned char *p = r->bs.buffer + r->bs.buffer_offset_current;
+			size_t sz = r->bs.buffer_size - r->bs.buffer_offset_current;
+			size_t a = varint_read(p, sz, &value_delta);
+			size_t b = a == 0 ? 0 : varint_read(p + a, sz - a, &run);
+			if (b == 0 || run == 0 || run > UINT32_MAX) {
+				r->count = r->position; // corrupted, the block ends here
+				break;
+			}
+
+			r->bs.buffer_offset_current += a + b;
+			r->last += zigzag_decode(value_delta);
+			r->run = run;
+		}
+
+		size_t m = r->run < n - i ? r->run : n - i;
+		if (r->delta == 0) {
+			for (size_t j = 0; j < m; ++j)
+				output[i + j] = r->last;
+		} else {
+			uint64_t base = r->last + (uint64_t)r->position * r->delta;
+			for (size_t j = 0; j < m; ++j)
+				output[i + j] = base + (uint64_t)j * r->delta;
+		}
+
+		i += m, r->run -= m, r->position += m;
+	}
+
+	return i;
+}
+
+static size_t u8_block_read_for(U8BlockReader *r, uint64_t *output, size_t n)
+{
+	size_t i = 0;
+	if (r->position == 0 && n > 0)
+		output[i++] = r->last; // the first value is in the index
+
+	uint64_t last = r->last;
+	if (r->width <= 57) {
+		for (; i < n; ++i)
+			output[i] = last += r->delta + bitstream_read_bit_n(&r->bs, r->width);
+	} else {
+		for (; i < n; ++i)
+			output[i] = last += r->delta + bitstream_read_long_n(&r->bs, r->width);
+	}
+
+	r->last = last;
+	r->position += n;
+	return n;
+}
+
+// the frame of TE_PFR:
+//   [[1byte], [1byte],       [16*width bytes],  [[1byte], [varint]] * exceptions]
+//    ^ width  ^ exceptions   ^ the packed low bits ^ the index and the high bits of a delta wider than width
+//
+// unpack and patch the frame at the reading position to v, the 128 values are
+// written even if the frame is the last one of the block.
+static int pfr_read_frame(U8BlockReader *r, uint64_t *v)
+{
+	unsigned char *p = r->bs.buffer + r->bs.buffer_offset_current;
+	size_t sz = r->bs.buffer_size - r->bs.buffer_offset_current;
+	if (sz < 2 || p[0] > 64 || sz - 2 < (size_t)p[0] * 16)
+		return -1;
+
+	uint8_t width = p[0], nexceptions = p[1];
+	pfr_unpack(v, p + 2, width);
+
+	size_t offset = 2 + (size_t)width * 16;
+	for (uint8_t k = 0; k < nexceptions; ++k) {
+		uint64_t high = 0;
+		size_t n = offset < sz ? varint_read(p + offset + 1, sz - offset - 1, &high) : 0;
+		if (n == 0 || p[offset] >= PFR_FRAME || width == 64)
+			return -1;
+
+		v[p[offset]] |= high << width;
+		offset += 1 + n;
+	}
+
+	r->bs.buffer_offset_current += offset;
+	return 0;
+}
+
+static size_t u8_block_read_pfr(U8BlockReader *r, uint64_t *output, size_t n)
+{
+	size_t i = 0;
+	if (r->position == 0 && n > 0)
+		output[i++] = r->last, r->position++; // the first value is in the index
+
+	while (i < n) {
+		if (r->frame_position == r->frame_count) {
+			size_t m = r->count - r->position < PFR_FRAME ? r->count - r->position : PFR_FRAME;
+
+			// a whole frame fits in the output, it is decoded there without a copy
+			uint64_t *v = n - i >= PFR_FRAME ? output + i : r->frame;
+			if (pfr_read_frame(r, v) != 0) {
+				r->count = r->position; // corrupted, the block ends here
+				break;
+			}
+
+			r->last = pfr_prefix_sum(v, m, r->last);
+			if (v != r->frame) {
+				i += m, r->position += m;
+				continue;
+			}
+
+			r->frame_position = 0, r->frame_count = m;
+		}
+
+		size_t left = r->frame_count - r->frame_position, m = left < n - i ? left : n - i;
+		memcpy(output + i, r->frame + r->frame_position, m * 8);
+		i += m, r->frame_position += m, r->position += m;
+	}
+
+	return i;
+}
+
+static size_t u8_block_read(U8BlockReader *r, uint64_t *output, size_t n)
+{
+	n = n < r->count - r->position ? n : r->count - r->position;
+
+	switch (r->type) {
+	case TE_LIN:
+		return u8_block_read_lin(r, output, n);
+	case TE_RLE:
+	case TE_REG:
+		return u8_block_read_rle(r, output, n);
+	case TE_FOR:
+		return u8_block_read_for(r, output, n);
+	case TE_PFR:
+		return u8_block_read_pfr(r, output, n);
+	default:
+		return u8_block_read_dod(r, output, n);
+	}
+}
+
+int _u8_decode(
+    unsigned char *input, size_t input_sz,	  //
+    uint64_t **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	U8BlockReader r;
+	if (u8_block_reader_init(&r, input, input_sz) != 0)
+		return -1;
+
+	// alloc memory
+	*output_sz = (size_t)r.count * 8;
+	*output = realloc_func(NULL, 0, *output_sz);
+
+	u8_block_read(&r, *output, r.count);
+	return 0;
+}
+
+// the blocked series, format version 1. the values are split to blocks of
+// TE_BLOCK_SIZE values, each block is encoded and compressed alone, so a slice
+// of the series only decodes the blocks it touches.
+//
+// binary format:
+//   [[1-3bytes], [4bytes],  [BlockIndex * nblocks], [block payload * nblocks]]
+//    ^ count     ^ nblocks  ^ the index of blocks    ^ the bitstream of the block, zstd compressed if TE_ZST
+//
+// the first value and the first delta of a block are in the index, the codec
+// of the payload is the smallest one for the block:
+//   TE_DI8: the delta of delta bitstream of values[2..n) without header
+//   TE_LIN: empty, values[i] = first + i * delta
+//   TE_RLE: [[varint], [varint]] * runs, zigzag of the run value minus the previous run value (the first value
+//           for the first run), and the length of the run
+//   TE_FOR: [[8bytes], [1byte], [bit stream]], the minimum delta, the bits of a delta, and the n-1 deltas minus the
+//           minimum, packed MSB first
+//   TE_PFR: [frame * ceil((n-1)/128)], the zigzag of the n-1 deltas in frames of 128, the last frame is padding
+//           with 0. only used when the codec is TE_CODEC_PFOR, see pfr_read_frame
+//   TE_REG: [[8bytes], [[varint], [varint]] * runs], the period, then TE_RLE of values[i] - i * period. a series
+//           sampled on a period has a run for every missed or late sample
+
+#define SERIES_HEADER_MAX_SZ (1 + 3 + 4)
+
+typedef struct __attribute__((packed)) BlockIndex {
+	uint64_t first;	 // the first value
+	int64_t delta;	 // the first delta (v1 - v0)
+	uint32_t count;	 // the number of values
+	uint32_t offset; // the offset of the payload from the first payload
+	uint8_t header;	 // the payload type and TE_ZST
+} BlockIndex;
+
+_Static_assert(SERIES_PREFIX_SZ == SERIES_HEADER_MAX_SZ + sizeof(BlockIndex), "the prefix of the series");
+
+static int series_header_size(size_t count)
+{
+	int header_sz = u8_header_size(count);
+	return header_sz < 0 ? -1 : header_sz - 8 - 8 + 4;
+}
+
+static int series_write_header(unsigned char *output, uint32_t count, uint32_t nblocks)
+{
+	// same as the header of u8, without the first value and delta
+	unsigned char header[U8_HEADER_MAX_SZ];
+	u8_write_header(header, count, 0, 0);
+	header[0] = (header[0] & ~TE_VER_MASK) | TE_VER1;
+
+	int header_sz = series_header_size(count);
+	memcpy(output, header, header_sz - 4);
+	memcpy(output + header_sz - 4, &nblocks, 4);
+	return header_sz;
+}
+
+static int series_read_header(unsigned char *input, size_t input_sz, uint32_t *count, uint32_t *nblocks)
+{
+	int header_sz = header_read(input, input_sz, TE_VER1, TE_DI8, count);
+	if (header_sz < 0 || input_sz < (size_t)header_sz + 4)
+		return -1;
+
+	memcpy(nblocks, input + header_sz, 4);
+	return header_sz + 4;
+}
+
+// the reader of a block of the blocked series
+static int u8_block_reader_open(U8BlockReader *r, BlockIndex *entry, unsigned char *payload, size_t payload_sz)
+{
+	*r = (U8BlockReader){
+	    .type = entry->header & TE___D_MASK & ~TE_ZST,
+	    .count = entry->count,
+	    .last = entry->first,
+	    .delta = entry->delta,
+	    .bs = bitstream_create(payload, payload_sz, 0),
+	};
+
+	switch (r->type) {
+	case TE_DI8:
+	case TE_LIN:
+	case TE_PFR:
+		return 0;
+	case TE_RLE:
+		r->delta = 0;
+		return 0;
+	case TE_REG:
+		if (payload_sz < 8)
+			return -1;
+
+		memcpy(&r->delta, payload, 8);
+		r->bs = bitstream_create(payload + 8, payload_sz - 8, 0);
+		return 0;
+	case TE_FOR:
+		if (payload_sz < 9 || payload[8] > 64)
+			return -1;
+
+		memcpy(&r->delta, payload, 8);
+		r->width = payload[8];
+		r->bs = bitstream_create(payload + 9, payload_sz - 9, 0);
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+// the payload of a block is at most 70 bits for each value with the delta of
+// delta, and 11 bytes for each value with TE_PFR when every delta is an
+// exception of a frame of width 0.
+#define U8_BLOCK_PAYLOAD_MAX(n) ((n) * 11 + 16)
+
+// the size of a delta of delta in bits, the same as u8_write_double_delta
+static inline uint8_t u8_double_delta_bits(int64_t double_delta)
+{
+	if (double_delta == 0)
+		return 1;
+	else if (-63 < double_delta && double_delta < 64)
+		return 2 + 1 + 6;
+	else if (-255 < double_delta && double_delta < 256)
+		return 3 + 1 + 8;
+	else if (-2047 < double_delta && double_delta < 2048)
+		return 4 + 1 + 11;
+	else if (INT32_MIN < double_delta && double_delta < INT32_MAX)
+		return 5 + 1 + 31;
+	else
+		return 6 + 1 + 63;
+}
+
+// the codec of a block and its payload size, every codec is measured in one
+// pass and the smallest one is kept. on a tie the faster one to decode wins.
+typedef struct U8BlockPlan {
+	uint8_t type;
+	size_t payload_sz;
+	int64_t min_delta; // TE_FOR: the reference. TE_REG: the period
+	uint8_t width;	   // TE_FOR: the bits of a delta
+} U8BlockPlan;
+
+// the payload size of TE_REG, the measure stops once it is larger than limit
+static size_t u8_block_reg_size(uint64_t *values, size_t n, uint64_t period, size_t limit)
+{
+	size_t sz = 8, run = 1;
+	uint64_t prev_run_value = values[0];
+	for (size_t i = 1; i <= n && sz <= limit; ++i) {
+		if (i < n && values[i] - values[i - 1] == period) {
+			run++;
+			continue;
+		}
+
+		uint64_t run_value = values[i - 1] - (uint64_t)(i - 1) * period;
+		sz += varint_size(zigzag_encode(run_value - prev_run_value)) + varint_size(run);
+		prev_run_value = run_value, run = 1;
+	}
+
+	return sz;
+}
+
+static bool u8_block_linear(uint64_t *values, size_t n)
+{
+	for (size_t i = 2; i < n; ++i) {
+		if (values[i] - values[i - 1] != values[1] - values[0])
+			return false;
+	}
+
+	return true;
+}
+
+static U8BlockPlan u8_block_plan(uint64_t *values, size_t n)
+{
+	if (n < 3)
+		return (U8BlockPlan){.type = TE_DI8}; // the values are all in the index
+
+	// the constant delta has no payload, it is faster than any frame
+	if (u8_codec == TE_CODEC_PFOR)
+		return (U8BlockPlan){.type = u8_block_linear(values, n) ? TE_LIN : TE_PFR};
+
+	int64_t first_delta = values[1] - values[0], delta = first_delta;
+	int64_t min_delta = delta, max_delta = delta;
+	size_t dod_bits = 0, rle_sz = 0;
+	bool linear = true;
+
+	uint64_t run_value = values[0], prev_run_value = values[0];
+	size_t run = 1;
+
+	// the dominant delta by the majority vote, the period of TE_REG
+	int64_t period = first_delta;
+	size_t votes = 0;
+
+	for (size_t i = 1; i < n; ++i) {
+		int64_t d = values[i] - values[i - 1];
+		if (i >= 2)
+			dod_bits += u8_double_delta_bits((int64_t)((uint64_t)d - (uint64_t)delta));
+
+		period = votes == 0 ? d : period;
+		votes = d == period ? votes + 1 : votes - 1;
+
+		delta = d;
+		linear &= d == first_delta;
+		min_delta = d < min_delta ? d : min_delta;
+		max_delta = d > max_delta ? d : max_delta;
+
+		if (values[i] == run_value) {
+			run++;
+			continue;
+		}
+
+		rle_sz += varint_size(zigzag_encode(run_value - prev_run_value)) + varint_size(run);
+		prev_run_value = run_value, run_value = values[i], run = 1;
+	}
+	rle_sz += varint_size(zigzag_encode(run_value - prev_run_value)) + varint_size(run);
+
+	if (linear)
+		return (U8BlockPlan){.type = TE_LIN};
+
+	uint64_t range = (uint64_t)max_delta - (uint64_t)min_delta;
+	uint8_t width = range == 0 ? 0 : 64 - __builtin_clzll(range);
+
+	U8BlockPlan plans[] = {
+	    {.type = TE_RLE, .payload_sz = rle_sz},
+	    {.type = TE_FOR, .payload_sz = 8 + 1 + ((n - 1) * width + 7) / 8, .min_delta = min_delta, .width = width},
+	    {.type = TE_DI8, .payload_sz = (dod_bits + 7) / 8},
+	};
+
+	U8BlockPlan best = plans[0];
+	for (size_t i = 1; i < sizeof(plans) / sizeof(plans[0]); ++i) {
+		if (plans[i].payload_sz < best.payload_sz)
+			best = plans[i];
+	}
+
+	// the vote leaves a candidate even without a majority, the runs of the
+	// period are measured only when most of the deltas are the period
+	size_t nperiod = 0;
+	for (size_t i = 1; i < n; ++i)
+		nperiod += values[i] - values[i - 1] == (uint64_t)period;
+
+	if (period != 0 && nperiod > n / 2) {
+		size_t reg_sz = u8_block_reg_size(values, n, period, best.payload_sz);
+		if (reg_sz < best.payload_sz)
+			best = (U8BlockPlan){.type = TE_REG, .payload_sz = reg_sz, .min_delta = period};
+	}
+
+	return best;
+}
+
+// the runs of values[i] - i * period, the period is 0 for TE_RLE
+static size_t u8_block_write_rle(unsigned char *output, uint64_t *values, size_t n, uint64_t period)
+{
+	size_t sz = 0, run = 1;
+	uint64_t prev_run_value = values[0];
+	for (size_t i = 1; i <= n; ++i) {
+		if (i < n && values[i] - values[i - 1] == period) {
+			run++;
+			continue;
+		}
+
+		uint64_t run_value = values[i - 1] - (uint64_t)(i - 1) * period;
+		sz += varint_write(output + sz, zigzag_encode(run_value - prev_run_value));
+		sz += varint_write(output + sz, run);
+		prev_run_value = run_value, run = 1;
+	}
+
+	return sz;
+}
+
+static size_t u8_block_write_reg(unsigned char *output, uint64_t *values, size_t n, uint64_t period)
+{
+	memcpy(output, &period, 8);
+	return 8 + u8_block_write_rle(output + 8, values, n, period);
+}
+
+static size_t u8_block_write_for(unsigned char *output, uint64_t *values, size_t n, int64_t min_delta, uint8_t width)
+{
+	memcpy(output, &min_delta, 8);
+	output[8] = width;
+
+	BitStream bs = bitstream_create(output + 9, U8_BLOCK_PAYLOAD_MAX(n), 0);
+	for (size_t i = 1; i < n; ++i)
+		bitstream_write_bit_n(&bs, values[i] - values[i - 1] - min_delta, width);
+
+	bitstream_flush(&bs);
+	return 9 + bs.buffer_offset_current;
+}
+
+// the width of a frame is the one of the smallest frame, the deltas wider
+// than it are the exceptions. the histogram of the bits of the deltas gives the
+// size of every width.
+static uint8_t pfr_frame_width(const uint64_t *v, size_t m)
+{
+	size_t hist[65] = {0};
+	uint8_t max = 0;
+	for (size_t j = 0; j < m; ++j) {
+		uint8_t bits = v[j] == 0 ? 0 : 64 - __builtin_clzll(v[j]);
+		hist[bits]++;
+		max = bits > max ? bits : max;
+	}
+
+	uint8_t best = max;
+	size_t best_sz = (size_t)max * 16;
+	for (uint8_t width = 0; width < max; ++width) {
+		size_t sz = (size_t)width * 16;
+		for (uint8_t bits = width + 1; bits <= max; ++bits)
+			sz += hist[bits] * (1 + (bits - width + 6) / 7);
+
+		if (sz < best_sz)
+			best = width, best_sz = sz;
+	}
+
+	return best;
+}
+
+static size_t u8_block_write_pfr(unsigned char *output, uint64_t *values, size_t n)
+{
+	size_t sz = 0;
+	for (size_t i = 1; i < n; i += PFR_FRAME) {
+		size_t m = n - i < PFR_FRAME ? n - i : PFR_FRAME;
+
+		uint64_t v[PFR_FRAME] = {0};
+		for (size_t j = 0; j < m; ++j)
+			v[j] = zigzag_encode(values[i + j] - values[i + j - 1]);
+
+		uint8_t width = pfr_frame_width(v, m), nexceptions = 0;
+		unsigned char *frame = output + sz;
+		pfr_pack(frame + 2, v, width);
+
+		sz += 2 + (size_t)width * 16;
+		for (size_t j = 0; j < m && width < 64; ++j) {
+			if ((v[j] >> width) == 0)
+				continue;
+
+			output[sz++] = j;
+			sz += varint_write(output + sz, v[j] >> width);
+			nexceptions++;
+		}
+
+		frame[0] = width, frame[1] = nexceptions;
+	}
+
+	return sz;
+}
+
+// write the delta of delta of values[2..n) to the bitstream
+static void u8_block_write(BitStream *bs, uint64_t *values, size_t n)
+{
+	for (size_t i = 2; i < n; ++i) {
+		// double_delta = (v[i] - v[i-1]) - (v[i-1] - v[i-2])
+		//              = v[i] -2*v[i-1] + v[i-2]
+		int64_t double_delta = values[i] - 2 * values[i - 1] + values[i - 2];
+		u8_write_double_delta(bs, double_delta);
+	}
+}
+
+// compress the bitstream of a block to the output, the raw bitstream is
+// stored if zstd does not pay. TE_ZST is set to the header if compressed,
+// returns the size written.
+static size_t u8_block_compress(
+    unsigned char *output, size_t output_sz,	   //
+    unsigned char *bitstream, size_t bitstream_sz, //
+    uint32_t dictionary, uint8_t *header	   //
+)
+{
+	if (zstd_stage != TE_STAGE_NONE) {
+		size_t csz = zstd_compress(output, output_sz, bitstream, bitstream_sz, dictionary);
+		if (ZSTD_isError(csz))
+			return csz;
+
+		if (zstd_pays(bitstream_sz, csz)) {
+			*header |= TE_ZST;
+			return csz;
+		}
+	}
+
+	memcpy(output, bitstream, bitstream_sz);
+	return bitstream_sz;
+}
+
+// encode a block with the smallest codec, then the second stage. the payload
+// is written to the scratch of U8_BLOCK_PAYLOAD_MAX(n) bytes first. returns
+// the size written to the output, the offset of the entry is not set.
+static size_t u8_block_encode(
+    uint64_t *values, size_t n, unsigned char *scratch,	//
+    unsigned char *output, size_t output_sz,		//
+    uint32_t dictionary, BlockIndex *entry		//
+)
+{
+	U8BlockPlan plan = u8_block_plan(values, n);
+
+	size_t payload_sz = 0;
+	if (plan.type == TE_RLE) {
+		payload_sz = u8_block_write_rle(scratch, values, n, 0);
+	} else if (plan.type == TE_REG) {
+		payload_sz = u8_block_write_reg(scratch, values, n, plan.min_delta);
+	} else if (plan.type == TE_FOR) {
+		payload_sz = u8_block_write_for(scratch, values, n, plan.min_delta, plan.width);
+	} else if (plan.type == TE_PFR) {
+		payload_sz = u8_block_write_pfr(scratch, values, n);
+	} else if (plan.type == TE_DI8) {
+		BitStream bs = bitstream_create(scratch, U8_BLOCK_PAYLOAD_MAX(n), 0);
+		u8_block_write(&bs, values, n);
+		bitstream_flush(&bs);
+		payload_sz = bs.buffer_offset_current;
+	}
+
+	*entry = (BlockIndex){
+	    .first = values[0],
+	    .delta = n > 1 ? values[1] - values[0] : 0,
+	    .count = n,
+	    .header = plan.type,
+	};
+	return u8_block_compress(output, output_sz, scratch, payload_sz, dictionary, &entry->header);
+}
+
+int _u8_series_encode(
+    uint64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	return _u8_series_encode_dict(input, input_sz, 0, output, output_sz, realloc_func);
+}
+
+// the series is written after the first offset bytes of the output, which are
+// left to the caller
+static int u8_series_write(
+    uint64_t *input, size_t input_sz,		  //
+    uint32_t dictionary, size_t offset,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	int header_sz = series_header_size(input_sz);
+	if (header_sz < 0)
+		return -1; // will overflow
+
+	uint32_t nblocks = (input_sz + TE_BLOCK_SIZE - 1) / TE_BLOCK_SIZE;
+
+	// the output grows with the encoded blocks instead of being allocated for
+	// the worst case, the peak memory is the input plus about the output. the
+	// raw payload of a block is written at the end of the output, and the
+	// output has room for the compressed block before the payload.
+	size_t payload_cap = U8_BLOCK_PAYLOAD_MAX(input_sz < TE_BLOCK_SIZE ? input_sz : TE_BLOCK_SIZE);
+	size_t block_cap = ZSTD_compressBound(payload_cap) + payload_cap;
+	size_t blocks_offset = offset + header_sz + nblocks * sizeof(BlockIndex), blocks_sz = 0;
+	size_t cap = blocks_offset + block_cap;
+	*output = realloc_func(NULL, 0, cap);
+
+	series_write_header(*output + offset, input_sz, nblocks);
+
+	for (uint32_t b = 0; b < nblocks; ++b) {
+		uint64_t *values = input + (size_t)b * TE_BLOCK_SIZE;
+		size_t n = input_sz - (size_t)b * TE_BLOCK_SIZE;
+		n = n < TE_BLOCK_SIZE ? n : TE_BLOCK_SIZE;
+
+		size_t need = blocks_offset + blocks_sz + block_cap;
+		if (cap < need) {
+			size_t new_cap = cap * 2 > need ? cap * 2 : need;
+			*output = realloc_func(*output, cap, new_cap);
+			cap = new_cap;
+		}
+
+		unsigned char *blocks = *output + blocks_offset, *scratch = *output + cap - payload_cap;
+
+		BlockIndex entry;
+		size_t csz = u8_block_encode(
+		    values, n, scratch, blocks + blocks_sz, scratch - (blocks + blocks_sz), dictionary, &entry);
+		if (ZSTD_isError(csz))
+			return -1;
+
+		entry.offset = blocks_sz;
+		memcpy(*output + offset + header_sz + b * sizeof(BlockIndex), &entry, sizeof(BlockIndex));
+		blocks_sz += csz;
+	}
+
+	// the room of the last payload is given back
+	*output_sz = blocks_offset + blocks_sz;
+	*output = realloc_func(*output, cap, *output_sz);
+	return 0;
+}
+
+int _u8_series_encode_dict(
+    uint64_t *input, size_t input_sz,		  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	return u8_series_write(input, input_sz, dictionary, 0, output, output_sz, realloc_func);
+}
+
+// the values with nulls. the values which are not null are encoded as usual,
+// and the validity of every value is kept as runs in front of them.
+//
+// binary format:
+//   [[1-3bytes], [4bytes],      [[varint] * runs],             [values]]
+//    ^ count     ^ size of runs ^ the lengths of the runs      ^ the values which are not null, encoded as usual
+//
+// the header is TE_VER3 with the type of the values, TE_DI8 or TE_DF8. the
+// runs alternate between valid and null values, the first run is of valid
+// values and is 0 if the first value is null, no other run is 0. the validity
+// is the null bitmap of a postgres array: bit i, LSB first, is set if the i-th
+// value is not null.
+
+// the header has the layout of the series, with the size of runs in place of nblocks
+static int nulls_write_header(unsigned char *output, uint8_t type, uint32_t count, uint32_t runs_sz)
+{
+	int header_sz = series_write_header(output, count, runs_sz);
+	output[0] = (output[0] & TE__SZ_MASK) | TE_VER3 | type;
+	return header_sz;
+}
+
+static inline bool validity_get(uint8_t *validity, size_t i) { return (validity[i / 8] >> (i % 8)) & 1; }
+
+// the runs of the validity are written to output, or only measured if output
+// is NULL. returns the size of the runs.
+static size_t nulls_runs_write(uint8_t *validity, size_t count, unsigned char *output, size_t *nvalid)
+{
+	size_t sz = 0, i = 0;
+	*nvalid = 0;
+	for (bool valid = true; i < count; valid = !valid) {
+		size_t start = i;
+		while (i < count && validity_get(validity, i) == valid) {
+			// a whole byte of the same validity
+			if (i % 8 == 0 && i + 8 <= count && validity[i / 8] == (valid ? 0xFF : 0x00))
+				i += 8;
+			else
+				i++;
+		}
+
+		*nvalid += valid ? i - start : 0;
+		sz += output == NULL ? varint_size(i - start) : varint_write(output + sz, i - start);
+	}
+
+	return sz;
+}
+
+// the runs of a value with nulls, and the encoded values after them
+static int nulls_parse(
+    unsigned char *input, size_t input_sz,    //
+    uint32_t *count,			      //
+    unsigned char **runs, size_t *runs_sz,    //
+    unsigned char **values, size_t *values_sz //
+)
+{
+	if (input_sz < 1)
+		return -1;
+
+	uint32_t size = 0;
+	int header_sz = header_read(input, input_sz, TE_VER3, input[0] & TE___D_MASK, count);
+	if (header_sz < 0 || input_sz - header_sz < 4)
+		return -1;
+
+	memcpy(&size, input + header_sz, 4);
+	header_sz += 4;
+	if (input_sz - header_sz < size)
+		return -1;
+
+	*runs = input + header_sz, *runs_sz = size;
+	*values = *runs + size, *values_sz = input_sz - header_sz - size;
+	return 0;
+}
+
+bool _nulls_exist(unsigned char *input, size_t input_sz)
+{
+	return input_sz > 0 && (input[0] & TE_VER_MASK) == TE_VER3;
+}
+
+int _nulls_read(
+    unsigned char *input, size_t input_sz,    //
+    uint32_t *count, uint32_t *nvalid,	      //
+    uint8_t *validity,			      //
+    unsigned char **values, size_t *values_sz //
+)
+{
+	unsigned char *runs = NULL;
+	size_t runs_sz = 0;
+	if (nulls_parse(input, input_sz, count, &runs, &runs_sz, values, values_sz) != 0)
+		return -1;
+
+	if (validity != NULL)
+		memset(validity, 0, ((size_t)*count + 7) / 8);
+
+	size_t rows = 0, offset = 0;
+	*nvalid = 0;
+	for (bool valid = true; offset < runs_sz; valid = !valid) {
+		uint64_t run = 0;
+		size_t n = varint_read(runs + offset, runs_sz - offset, &run);
+		if (n == 0 || run > *count - rows)
+			return -1;
+
+		offset += n;
+		if (!valid) {
+			rows += run;
+			continue;
+		}
+
+		// the bits of the run are set a byte at a time between the edges
+		size_t i = rows;
+		rows += run, *nvalid += run;
+		if (validity == NULL)
+			continue;
+
+		for (; i < rows && i % 8 != 0; ++i)
+			validity[i / 8] |= 1 << (i % 8);
+
+		memset(validity + i / 8, 0xFF, (rows - i) / 8);
+		for (i += (rows - i) / 8 * 8; i < rows; ++i)
+			validity[i / 8] |= 1 << (i % 8);
+	}
+
+	return rows == *count ? 0 : -1;
+}
+
+int _u8_series_encode_nulls(
+    uint64_t *input,				  //
+    uint8_t *validity, size_t count,		  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	if (validity == NULL)
+		return u8_series_write(input, count, dictionary, 0, output, output_sz, realloc_func);
+
+	int header_sz = series_header_size(count);
+	if (header_sz < 0)
+		return -1; // will overflow
+
+	// without a null the series is written as usual
+	size_t nvalid = 0, runs_sz = nulls_runs_write(validity, count, NULL, &nvalid);
+	if (nvalid == count)
+		return u8_series_write(input, count, dictionary, 0, output, output_sz, realloc_func);
+
+	if (u8_series_write(input, nvalid, dictionary, header_sz + runs_sz, output, output_sz, realloc_func) != 0)
+		return -1;
+
+	nulls_write_header(*output, TE_DI8, count, runs_sz);
+	nulls_runs_write(validity, count, *output + header_sz, &nvalid);
+	return 0;
+}
+
+// the streaming version of _u8_series_encode. the values of the block being
+// written are kept, and the block is encoded when it is full. the output is
+// byte exact with _u8_series_encode.
+struct U8Encoder {
+	uint32_t count;
+
+	// the values of the block being written
+	uint64_t *values;
+	uint32_t block_count;
+	size_t values_cap;
+
+	// the finished blocks, compressed
+	BlockIndex *index;
+	uint32_t nblocks;
+	size_t index_cap;
+	unsigned char *blocks;
+	size_t blocks_sz, blocks_cap;
+
+	// the output of finish, also the scratch of the payload of a block
+	unsigned char *output;
+	size_t output_cap;
+
+	// the runs of valid and null values from a run of valid values, only kept
+	// once a null is appended
+	uint32_t *runs;
+	uint32_t nruns, nulls;
+	size_t runs_cap;
+
+	void *(*realloc_func)(void *, size_t, size_t);
+};
+
+// grow the buffer to at least n bytes
+static void *u8_encoder_reserve(U8Encoder *e, void *p, size_t *cap, size_t n)
+{
+	if (n <= *cap)
+		return p;
+
+	size_t new_cap = *cap < 64 ? 64 : *cap;
+	while (new_cap < n)
+		new_cap *= 2;
+
+	p = e->realloc_func(p, *cap, new_cap);
+	*cap = new_cap;
+	return p;
+}
+
+// the buffers are NULL until they are used, memcpy can not take NULL even for
+// 0 bytes
+static inline void u8_encoder_copy(void *dst, const void *src, size_t n)
+{
+	if (n > 0)
+		memcpy(dst, src, n);
+}
+
+static int u8_encoder_close_block(U8Encoder *e)
+{
+	size_t payload_cap = U8_BLOCK_PAYLOAD_MAX(e->block_count);
+	size_t bound = ZSTD_compressBound(payload_cap);
+	e->blocks = u8_encoder_reserve(e, e->blocks, &e->blocks_cap, e->blocks_sz + bound);
+	e->index = u8_encoder_reserve(e, e->index, &e->index_cap, (e->nblocks + 1) * sizeof(BlockIndex));
+	e->output = u8_encoder_reserve(e, e->output, &e->output_cap, payload_cap);
+
+	BlockIndex entry;
+	size_t csz = u8_block_encode(e->values, e->block_count, e->output, e->blocks + e->blocks_sz, bound, 0, &entry);
+	if (ZSTD_isError(csz))
+		return -1;
+
+	entry.offset = e->blocks_sz;
+	e->index[e->nblocks++] = entry;
+	e->blocks_sz += csz;
+	e->block_count = 0;
+	return 0;
+}
+
+U8Encoder *_u8_encoder_create(void *(*realloc_func)(void *, size_t, size_t))
+{
+	U8Encoder *e = realloc_func(NULL, 0, sizeof(U8Encoder));
+	*e = (U8Encoder){.realloc_func = realloc_func};
+	return e;
+}
+
+void _u8_encoder_free(U8Encoder *e, void (*free_func)(void *))
+{
+	void *buffers[] = {e->values, e->index, e->blocks, e->output, e->runs, e};
+	for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); ++i) {
+		if (buffers[i] != NULL)
+			free_func(buffers[i]);
+	}
+}
+
+// the run is added to the last run of the same validity, so no run is 0 but
+// the first one
+static void u8_encoder_runs_push(U8Encoder *e, bool valid, uint32_t n)
+{
+	if (n == 0)
+		return;
+
+	if (e->nruns > 0 && (e->nruns % 2 == 1) == valid) {
+		e->runs[e->nruns - 1] += n;
+		return;
+	}
+
+	e->runs = u8_encoder_reserve(e, e->runs, &e->runs_cap, (e->nruns + 2) * sizeof(uint32_t));
+	if (e->nruns == 0 && !valid)
+		e->runs[e->nruns++] = 0;
+
+	e->runs[e->nruns++] = n;
+}
+
+static int u8_encoder_append_values(U8Encoder *e, uint64_t *values, size_t n)
+{
+	if (e->count + e->nulls + n > 0xFFFFFF)
+		return -1; // will overflow
+
+	for (size_t i = 0; i < n;) {
+		if (e->block_count == TE_BLOCK_SIZE && u8_encoder_close_block(e) != 0)
+			return -1;
+
+		size_t m = n - i < TE_BLOCK_SIZE - e->block_count ? n - i : TE_BLOCK_SIZE - e->block_count;
+		e->values = u8_encoder_reserve(e, e->values, &e->values_cap, (e->block_count + m) * 8);
+		memcpy(e->values + e->block_count, values + i, m * 8);
+		e->block_count += m;
+		i += m;
+	}
+
+	e->count += n;
+	return 0;
+}
+
+int _u8_encoder_append_n(U8Encoder *e, uint64_t *values, size_t n)
+{
+	if (u8_encoder_append_values(e, values, n) != 0)
+		return -1;
+
+	if (e->nulls > 0)
+		u8_encoder_runs_push(e, true, n);
+
+	return 0;
+}
+
+int _u8_encoder_append(U8Encoder *e, uint64_t value) { return _u8_encoder_append_n(e, &value, 1); }
+
+static int u8_encoder_append_null_n(U8Encoder *e, size_t n)
+{
+	if (e->count + e->nulls + n > 0xFFFFFF)
+		return -1; // will overflow
+
+	// the values before the first null are the first run
+	if (e->nulls == 0)
+		e->nruns = 0, u8_encoder_runs_push(e, true, e->count);
+
+	u8_encoder_runs_push(e, false, n);
+	e->nulls += n;
+	return 0;
+}
+
+int _u8_encoder_append_null(U8Encoder *e) { return u8_encoder_append_null_n(e, 1); }
+
+int _u8_encoder_append_nulls(U8Encoder *e, uint64_t *values, uint8_t *validity, size_t count)
+{
+	if (validity == NULL)
+		return _u8_encoder_append_n(e, values, count);
+
+	for (size_t i = 0, nvalid = 0; i < count;) {
+		bool valid = validity_get(validity, i);
+		size_t start = i;
+		while (i < count && validity_get(validity, i) == valid)
+			i++;
+
+		size_t n = i - start;
+		if (valid ? _u8_encoder_append_n(e, values + nvalid, n) : u8_encoder_append_null_n(e, n))
+			return -1;
+
+		nvalid += valid ? n : 0;
+	}
+
+	return 0;
+}
+
+// append the values of other after the values of e, other is not changed. the
+// finished blocks of other are copied without encoding them again, so the open
+// block of e is closed first and may be shorter than TE_BLOCK_SIZE.
+int _u8_encoder_merge(U8Encoder *e, U8Encoder *other)
+{
+	if (e->count + e->nulls + other->count + other->nulls > 0xFFFFFF)
+		return -1; // will overflow
+
+	// the runs of other follow the runs of e, the values of an encoder without
+	// nulls are one run
+	if (e->nulls > 0 || other->nulls > 0) {
+		if (e->nulls == 0)
+			e->nruns = 0, u8_encoder_runs_push(e, true, e->count);
+
+		if (other->nulls == 0)
+			u8_encoder_runs_push(e, true, other->count);
+
+		for (uint32_t i = 0; other->nulls > 0 && i < other->nruns; ++i)
+			u8_encoder_runs_push(e, i % 2 == 0, other->runs[i]);
+
+		e->nulls += other->nulls;
+	}
+
+	if (other->nblocks == 0)
+		return u8_encoder_append_values(e, other->values, other->block_count);
+
+	if (e->block_count > 0 && u8_encoder_close_block(e) != 0)
+		return -1;
+
+	e->index = u8_encoder_reserve(e, e->index, &e->index_cap, (e->nblocks + other->nblocks) * sizeof(BlockIndex));
+	e->blocks = u8_encoder_reserve(e, e->blocks, &e->blocks_cap, e->blocks_sz + other->blocks_sz);
+	e->values = u8_encoder_reserve(e, e->values, &e->values_cap, other->block_count * 8);
+
+	for (uint32_t b = 0; b < other->nblocks; ++b) {
+		e->index[e->nblocks + b] = other->index[b];
+		e->index[e->nblocks + b].offset += e->blocks_sz;
+	}
+
+	u8_encoder_copy(e->blocks + e->blocks_sz, other->blocks, other->blocks_sz);
+	u8_encoder_copy(e->values, other->values, other->block_count * 8);
+
+	e->count += other->count;
+	e->nblocks += other->nblocks;
+	e->blocks_sz += other->blocks_sz;
+	e->block_count = other->block_count;
+	return 0;
+}
+
+// the state of the encoder as bytes, the output is allocated by the realloc of
+// the encoder.
+//
+// binary format:
+//   [[4bytes], [4bytes],      [4bytes],  [8bytes],    [4bytes], [BlockIndex * nblocks], [blocks],  [8bytes * block_count], [4bytes * nruns]]
+//    ^ count   ^ block_count  ^ nblocks  ^ blocks_sz  ^ nruns   ^ the finished blocks              ^ the open block        ^ the runs, 0 without nulls
+#define U8_ENCODER_STATE_SZ (4 + 4 + 4 + 8 + 4)
+
+int _u8_encoder_serialize(U8Encoder *e, unsigned char **output, size_t *output_sz)
+{
+	uint64_t blocks_sz = e->blocks_sz;
+	uint32_t nruns = e->nulls > 0 ? e->nruns : 0;
+	size_t index_sz = e->nblocks * sizeof(BlockIndex), values_sz = e->block_count * 8, runs_sz = nruns * 4;
+
+	*output_sz = U8_ENCODER_STATE_SZ + index_sz + blocks_sz + values_sz + runs_sz;
+	*output = e->realloc_func(NULL, 0, *output_sz);
+
+	unsigned char *p = *output;
+	memcpy(p, &e->count, 4), p += 4;
+	memcpy(p, &e->block_count, 4), p += 4;
+	memcpy(p, &e->nblocks, 4), p += 4;
+	memcpy(p, &blocks_sz, 8), p += 8;
+	memcpy(p, &nruns, 4), p += 4;
+	u8_encoder_copy(p, e->index, index_sz), p += index_sz;
+	u8_encoder_copy(p, e->blocks, blocks_sz), p += blocks_sz;
+	u8_encoder_copy(p, e->values, values_sz), p += values_sz;
+	u8_encoder_copy(p, e->runs, runs_sz);
+	return 0;
+}
+
+// NULL if the input is truncated, or the blocks and the runs do not add up to
+// the values. the state is checked before the encoder is allocated.
+U8Encoder *_u8_encoder_deserialize(
+    unsigned char *input, size_t input_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	uint32_t count = 0, block_count = 0, nblocks = 0, nruns = 0;
+	uint64_t blocks_sz = 0;
+	if (input_sz < U8_ENCODER_STATE_SZ)
+		return NULL;
+
+	memcpy(&count, input, 4);
+	memcpy(&block_count, input + 4, 4);
+	memcpy(&nblocks, input + 8, 4);
+	memcpy(&blocks_sz, input + 12, 8);
+	memcpy(&nruns, input + 20, 4);
+
+	size_t index_sz = (size_t)nblocks * sizeof(BlockIndex), values_sz = (size_t)block_count * 8;
+	size_t runs_sz = (size_t)nruns * 4;
+	if (block_count > TE_BLOCK_SIZE || count > 0xFFFFFF || nblocks > count || nruns > 0xFFFFFF + 1 ||
+	    blocks_sz > UINT32_MAX || input_sz != U8_ENCODER_STATE_SZ + index_sz + blocks_sz + values_sz + runs_sz)
+		return NULL;
+
+	unsigned char *index = input + U8_ENCODER_STATE_SZ, *blocks = index + index_sz;
+	unsigned char *values = blocks + blocks_sz, *runs = values + values_sz;
+
+	// the closed blocks and the open block must add up to the values, and the
+	// payload of a block ends at the offset of the next one
+	uint64_t closed = 0;
+	for (uint32_t b = 0; b < nblocks; ++b) {
+		BlockIndex entry, next = {.offset = blocks_sz};
+		memcpy(&entry, index + b * sizeof(BlockIndex), sizeof(BlockIndex));
+		if (b + 1 < nblocks)
+			memcpy(&next, index + (b + 1) * sizeof(BlockIndex), sizeof(BlockIndex));
+
+		if (entry.count == 0 || entry.count > TE_BLOCK_SIZE || entry.offset > next.offset ||
+		    next.offset > blocks_sz)
+			return NULL;
+
+		closed += entry.count;
+	}
+
+	if (closed + block_count != count)
+		return NULL;
+
+	// the runs of valid values must add up to the values
+	uint64_t valid = 0, nulls = 0;
+	for (uint32_t i = 0; i < nruns; ++i) {
+		uint32_t run = 0;
+		memcpy(&run, runs + i * 4, 4);
+		*(i % 2 == 0 ? &valid : &nulls) += run;
+	}
+
+	if (nruns > 0 && (valid != count || nulls == 0 || count + nulls > 0xFFFFFF))
+		return NULL;
+
+	U8Encoder *e = _u8_encoder_create(realloc_func);
+	e->index = u8_encoder_reserve(e, e->index, &e->index_cap, index_sz);
+	e->blocks = u8_encoder_reserve(e, e->blocks, &e->blocks_cap, blocks_sz);
+	e->values = u8_encoder_reserve(e, e->values, &e->values_cap, values_sz);
+	e->runs = u8_encoder_reserve(e, e->runs, &e->runs_cap, runs_sz);
+
+	u8_encoder_copy(e->index, index, index_sz);
+	u8_encoder_copy(e->blocks, blocks, blocks_sz);
+	u8_encoder_copy(e->values, values, values_sz);
+	u8_encoder_copy(e->runs, runs, runs_sz);
+
+	e->count = count, e->block_count = block_count, e->nblocks = nblocks, e->blocks_sz = blocks_sz;
+	e->nruns = nruns, e->nulls = nulls;
+	return e;
+}
+
+// the output points into the encoder and is valid until the next call. the
+// values are not changed, more values can be appended after finish.
+int _u8_encoder_finish(U8Encoder *e, unsigned char **output, size_t *output_sz)
+{
+	// the runs of a series with nulls are written in front of the series
+	size_t runs_sz = 0, offset = 0;
+	for (uint32_t i = 0; e->nulls > 0 && i < e->nruns; ++i)
+		runs_sz += varint_size(e->runs[i]);
+
+	if (e->nulls > 0)
+		offset = series_header_size(e->count + e->nulls) + runs_sz;
+
+	uint32_t nblocks = e->nblocks + (e->block_count > 0);
+	size_t index_sz = nblocks * sizeof(BlockIndex);
+	size_t payload_cap = U8_BLOCK_PAYLOAD_MAX(e->block_count);
+	size_t bound = ZSTD_compressBound(payload_cap);
+	size_t cap = offset + SERIES_HEADER_MAX_SZ + index_sz + e->blocks_sz + bound + payload_cap;
+	e->output = u8_encoder_reserve(e, e->output, &e->output_cap, cap);
+
+	if (e->nulls > 0) {
+		unsigned char *runs = e->output + nulls_write_header(e->output, TE_DI8, e->count + e->nulls, runs_sz);
+		for (uint32_t i = 0; i < e->nruns; ++i)
+			runs += varint_write(runs, e->runs[i]);
+	}
+
+	unsigned char *series = e->output + offset;
+	unsigned char *index = series + series_write_header(series, e->count, nblocks);
+	unsigned char *blocks = index + index_sz;
+
+	u8_encoder_copy(index, e->index, e->nblocks * sizeof(BlockIndex));
+	u8_encoder_copy(blocks, e->blocks, e->blocks_sz);
+
+	size_t blocks_sz = e->blocks_sz;
+	if (e->block_count > 0) {
+		// the payload of the last block is written after the bound of its output
+		unsigned char *scratch = blocks + blocks_sz + bound;
+
+		BlockIndex entry;
+		size_t csz = u8_block_encode(e->values, e->block_count, scratch, blocks + blocks_sz, bound, 0, &entry);
+		if (ZSTD_isError(csz))
+			return -1;
+
+		entry.offset = blocks_sz;
+		memcpy(index + e->nblocks * sizeof(BlockIndex), &entry, sizeof(BlockIndex));
+		blocks_sz += csz;
+	}
+
+	*output = e->output;
+	*output_sz = blocks + blocks_sz - e->output;
+	return 0;
+}
+
+// the streaming decoder of the series. it also reads the format before the
+// blocked series, which is a single block compressed by zstd as a whole.
+struct U8Decoder {
+	U8BlockReader reader; // the block being read
+
+	uint32_t count;		// the number of values of the series
+	uint32_t nblocks, next; // the number of blocks, the next block to read
+	unsigned char *index, *blocks;
+	size_t blocks_sz;
+
+	unsigned char *input; // the input of the format without blocks
+	size_t input_sz;
+
+	unsigned char *scratch; // the decompressed data
+	size_t scratch_sz;
+
+	// the runs of a series with nulls, NULL without nulls
+	unsigned char *runs;
+	size_t runs_sz, runs_read;
+	uint32_t rows, row; // the number of values and nulls, the next one
+	uint32_t run;	    // the rest of the current run
+	bool valid;	    // the validity of the current run
+
+	// the doubles of the float8 series of _f8_decoder_create are read in place
+	// of the integers, NULL for the series of integers
+	int (*read_values)(U8Decoder *d, uint64_t *output, size_t n, size_t *output_n);
+	int (*seek_values)(U8Decoder *d, size_t position);
+
+	// the float8 series scales the integers by the parameters of their block
+	unsigned char *params;
+	size_t params_sz, params_read; // the end of the parameters of the current block
+	uint32_t position, block_end;  // the next double, the end of its block
+	uint8_t e, f;
+	uint16_t exceptions; // of the current block, before params_read
+	float64_t *doubles;  // the gorilla XOR, decoded as a whole
+
+	void *(*realloc_func)(void *, size_t, size_t);
+};
+
+static int u8_decoder_init_values(
+    U8Decoder *d, unsigned char *input, size_t input_sz, //
+    void *(*realloc_func)(void *, size_t, size_t)	 //
+)
+{
+	*d = (U8Decoder){.realloc_func = realloc_func};
+
+	if (zstd_is_frame(input, input_sz)) {
+		if (_zstd_decode(input, input_sz, &d->scratch, &d->scratch_sz, realloc_func) != 0)
+			return -1;
+
+		input = d->scratch, input_sz = d->scratch_sz;
+	}
+
+	if (input_sz > 0 && (input[0] & TE_VER_MASK) == TE_VER) {
+		if (u8_block_reader_init(&d->reader, input, input_sz) != 0)
+			return -1;
+
+		d->input = input, d->input_sz = input_sz;
+		d->count = d->reader.count;
+		return 0;
+	}
+
+	int header_sz = series_read_header(input, input_sz, &d->count, &d->nblocks);
+	if (header_sz < 0 || (input_sz - header_sz) / sizeof(BlockIndex) < d->nblocks)
+		return -1;
+
+	d->index = input + header_sz;
+	d->blocks = d->index + d->nblocks * sizeof(BlockIndex);
+	d->blocks_sz = input_sz - (d->blocks - input);
+	return 0;
+}
+
+// the values of a series with nulls are read by the decoder of the values, the
+// runs are followed in front of it
+static int u8_decoder_init_rows(
+    U8Decoder *d, unsigned char *input, size_t input_sz,					 //
+    int (*init_values)(U8Decoder *, unsigned char *, size_t, void *(*)(void *, size_t, size_t)), //
+    void *(*realloc_func)(void *, size_t, size_t)						 //
+)
+{
+	if (!_nulls_exist(input, input_sz))
+		return init_values(d, input, input_sz, realloc_func);
+
+	uint32_t rows = 0, nvalid = 0;
+	unsigned char *runs = NULL, *values = NULL;
+	size_t runs_sz = 0, values_sz = 0;
+	if (nulls_parse(input, input_sz, &rows, &runs, &runs_sz, &values, &values_sz) != 0 ||
+	    _nulls_read(input, input_sz, &rows, &nvalid, NULL, &values, &values_sz) != 0 ||
+	    init_values(d, values, values_sz, realloc_func) != 0 || d->count != nvalid)
+		return -1;
+
+	d->runs = runs, d->runs_sz = runs_sz, d->rows = rows;
+	return 0;
+}
+
+static int u8_decoder_init(
+    U8Decoder *d, unsigned char *input, size_t input_sz, //
+    void *(*realloc_func)(void *, size_t, size_t)	 //
+)
+{
+	return u8_decoder_init_rows(d, input, input_sz, u8_decoder_init_values, realloc_func);
+}
+
+static int u8_decoder_load_block(U8Decoder *d, uint32_t block)
+{
+	BlockIndex entry, next;
+	memcpy(&entry, d->index + block * sizeof(BlockIndex), sizeof(BlockIndex));
+	next.offset = d->blocks_sz;
+	if (block + 1 < d->nblocks)
+		memcpy(&next, d->index + (block + 1) * sizeof(BlockIndex), sizeof(BlockIndex));
+
+	if (entry.offset > next.offset || next.offset > d->blocks_sz)
+		return -1;
+
+	unsigned char *payload = d->blocks + entry.offset;
+	size_t payload_sz = next.offset - entry.offset;
+
+	if (entry.header & TE_ZST) {
+		unsigned long long n = ZSTD_getFrameContentSize(payload, payload_sz);
+		if (n == ZSTD_CONTENTSIZE_UNKNOWN || n == ZSTD_CONTENTSIZE_ERROR)
+			return -1;
+
+		if (d->scratch_sz < n) {
+			d->scratch = d->realloc_func(d->scratch, d->scratch_sz, n);
+			d->scratch_sz = n;
+		}
+
+		if (zstd_decompress(d->scratch, n, payload, payload_sz) != n)
+			return -1;
+
+		payload = d->scratch, payload_sz = n;
+	}
+
+	if (u8_block_reader_open(&d->reader, &entry, payload, payload_sz) != 0)
+		return -1;
+
+	d->next = block + 1;
+	return 0;
+}
+
+U8Decoder *_u8_decoder_create(
+    unsigned char *input, size_t input_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	// the decoder is allocated once it is valid, nothing is left to free
+	U8Decoder init;
+	if (u8_decoder_init(&init, input, input_sz, realloc_func) != 0)
+		return NULL;
+
+	U8Decoder *d = realloc_func(NULL, 0, sizeof(U8Decoder));
+	*d = init;
+	return d;
+}
+
+void _u8_decoder_free(U8Decoder *d, void (*free_func)(void *))
+{
+	if (d->scratch != NULL)
+		free_func(d->scratch);
+
+	if (d->doubles != NULL)
+		free_func(d->doubles);
+
+	free_func(d);
+}
+
+uint32_t _u8_decoder_count(U8Decoder *d) { return d->runs != NULL ? d->rows : d->count; }
+
+static int u8_decoder_read_values(U8Decoder *d, uint64_t *output, size_t n, size_t *output_n)
+{
+	size_t total = 0;
+	while (true) {
+		total += u8_block_read(&d->reader, output + total, n - total);
+		if (total == n || d->next >= d->nblocks)
+			break;
+
+		if (u8_decoder_load_block(d, d->next) != 0)
+			return -1;
+	}
+
+	*output_n = total;
+	return 0;
+}
+
+static int u8_decoder_seek_values(U8Decoder *d, size_t position)
+{
+	position = position < d->count ? position : d->count;
+
+	size_t skip = position;
+	if (d->count == 0)
+		return 0; // an empty series has no block to read
+
+	if (d->nblocks == 0) {
+		if (u8_block_reader_init(&d->reader, d->input, d->input_sz) != 0)
+			return -1;
+	} else {
+		// find the block of the position
+		uint32_t block = 0;
+		for (; block + 1 < d->nblocks; ++block) {
+			BlockIndex entry;
+			memcpy(&entry, d->index + block * sizeof(BlockIndex), sizeof(BlockIndex));
+			if (skip < entry.count)
+				break;
+
+			skip -= entry.count;
+		}
+
+		if (u8_decoder_load_block(d, block) != 0)
+			return -1;
+	}
+
+	// values before the position in the block are decoded and dropped
+	uint64_t dropped[128];
+	while (skip > 0) {
+		size_t n = u8_block_read(&d->reader, dropped, skip < 128 ? skip : 128);
+		if (n == 0)
+			break;
+
+		skip -= n;
+	}
+
+	return 0;
+}
+
+static int u8_decoder_read(U8Decoder *d, uint64_t *output, size_t n, size_t *output_n)
+{
+	if (d->read_values != NULL)
+		return d->read_values(d, output, n, output_n);
+
+	return u8_decoder_read_values(d, output, n, output_n);
+}
+
+static int u8_decoder_seek(U8Decoder *d, size_t position)
+{
+	if (d->seek_values != NULL)
+		return d->seek_values(d, position);
+
+	return u8_decoder_seek_values(d, position);
+}
+
+// move to the next run which is not empty
+static int u8_decoder_next_run(U8Decoder *d)
+{
+	while (d->run == 0) {
+		uint64_t run = 0;
+		size_t n = varint_read(d->runs + d->runs_read, d->runs_sz - d->runs_read, &run);
+		if (n == 0)
+			return -1;
+
+		d->runs_read += n, d->run = run, d->valid = !d->valid;
+	}
+
+	return 0;
+}
+
+int _u8_decoder_read_nulls(U8Decoder *d, uint64_t *output, bool *nulls, size_t n, size_t *output_n)
+{
+	if (d->runs == NULL) {
+		if (u8_decoder_read(d, output, n, output_n) != 0)
+			return -1;
+
+		if (nulls != NULL)
+			memset(nulls, 0, *output_n);
+
+		return 0;
+	}
+
+	n = n < d->rows - d->row ? n : d->rows - d->row;
+	for (size_t total = 0, m, read; total < n; total += m) {
+		if (u8_decoder_next_run(d) != 0)
+			return -1;
+
+		m = n - total < d->run ? n - total : d->run;
+		if (d->valid && (u8_decoder_read(d, output + total, m, &read) != 0 || read != m))
+			return -1;
+
+		if (!d->valid && nulls == NULL)
+			return -1; // a null can only be read with nulls
+
+		if (!d->valid)
+			memset(output + total, 0, m * 8);
+
+		if (nulls != NULL)
+			memset(nulls + total, !d->valid, m);
+
+		d->run -= m, d->row += m;
+	}
+
+	*output_n = n;
+	return 0;
+}
+
+int _u8_decoder_read(U8Decoder *d, uint64_t *output, size_t n, size_t *output_n)
+{
+	return _u8_decoder_read_nulls(d, output, NULL, n, output_n);
+}
+
+// move to the position-th value, the next read starts from it. the values
+// before it are the valid runs before it.
+int _u8_decoder_seek(U8Decoder *d, size_t position)
+{
+	if (d->runs == NULL)
+		return u8_decoder_seek(d, position);
+
+	position = position < d->rows ? position : d->rows;
+	d->runs_read = 0, d->row = 0, d->run = 0, d->valid = false;
+
+	size_t values = 0;
+	while (d->row < position) {
+		if (u8_decoder_next_run(d) != 0)
+			return -1;
+
+		size_t m = position - d->row < d->run ? position - d->row : d->run;
+		values += d->valid ? m : 0;
+		d->run -= m, d->row += m;
+	}
+
+	return u8_decoder_seek(d, values);
+}
+
+// reopen a finished series to append more values. the blocks are copied
+// without decoding them, except the last block which is decoded to the open
+// block if it is not full. the format before the blocked series is decoded as
+// a whole. NULL if the input is invalid.
+U8Encoder *_u8_encoder_open(
+    unsigned char *input, size_t input_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	U8Decoder d;
+	if (u8_decoder_init(&d, input, input_sz, realloc_func) != 0)
+		return NULL;
+
+	// the blocks copied as they are, all of them if the last one is full
+	uint32_t closed = d.nblocks, count = 0;
+	size_t blocks_sz = d.blocks_sz;
+	for (uint32_t b = 0; b < d.nblocks; ++b) {
+		BlockIndex entry;
+		memcpy(&entry, d.index + b * sizeof(BlockIndex), sizeof(BlockIndex));
+		if (b + 1 == d.nblocks && entry.count < TE_BLOCK_SIZE) {
+			closed = b, blocks_sz = entry.offset;
+			break;
+		}
+
+		count += entry.count;
+	}
+
+	if (blocks_sz > d.blocks_sz || count > d.count)
+		return NULL;
+
+	U8Encoder *e = _u8_encoder_create(realloc_func);
+	e->index = u8_encoder_reserve(e, e->index, &e->index_cap, closed * sizeof(BlockIndex));
+	e->blocks = u8_encoder_reserve(e, e->blocks, &e->blocks_cap, blocks_sz);
+	u8_encoder_copy(e->index, d.index, closed * sizeof(BlockIndex));
+	u8_encoder_copy(e->blocks, d.blocks, blocks_sz);
+	e->count = count, e->nblocks = closed, e->blocks_sz = blocks_sz;
+
+	// the values of the last block, or all values of the format before
+	uint64_t values[128];
+	size_t n = 0;
+	if (count < d.count && u8_decoder_seek_values(&d, count) != 0)
+		return NULL;
+
+	while (count < d.count) {
+		if (u8_decoder_read_values(&d, values, 128, &n) != 0 || n == 0 ||
+		    u8_encoder_append_values(e, values, n) != 0)
+			return NULL;
+
+		count += n;
+	}
+
+	// the runs of the nulls
+	for (size_t offset = 0, i = 0, read; d.runs != NULL && offset < d.runs_sz; offset += read, ++i) {
+		uint64_t run = 0;
+		if ((read = varint_read(d.runs + offset, d.runs_sz - offset, &run)) == 0)
+			return NULL;
+
+		u8_encoder_runs_push(e, i % 2 == 0, run);
+	}
+
+	e->nulls = d.runs != NULL ? d.rows - d.count : 0;
+	return e->count == d.count ? e : NULL;
+}
+
+int _u8_series_decode(
+    unsigned char *input, size_t input_sz,	  //
+    uint64_t **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	return _u8_series_slice(input, input_sz, 0, SIZE_MAX, output, output_sz, realloc_func);
+}
+
+int _u8_series_slice(
+    unsigned char *input, size_t input_sz,	  //
+    size_t start, size_t count,			  //
+    uint64_t **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	U8Decoder d;
+	if (u8_decoder_init(&d, input, input_sz, realloc_func) != 0)
+		return -1;
+
+	size_t rows = _u8_decoder_count(&d);
+	start = start < rows ? start : rows;
+	count = count < rows - start ? count : rows - start;
+
+	if (start != 0 && _u8_decoder_seek(&d, start) != 0)
+		return -1;
+
+	// alloc memory
+	*output = realloc_func(NULL, 0, count * 8);
+
+	size_t n = 0;
+	if (_u8_decoder_read(&d, *output, count, &n) != 0 || n != count)
+		return -1;
+
+	*output_sz = n * 8;
+	return 0;
+}
+
+// append a sample of training
+static void zstd_sample_append(
+    unsigned char **samples, size_t *samples_sz, size_t **sizes, size_t *nsamples, //
+    unsigned char *sample, size_t sample_sz,					   //
+    void *(*realloc_func)(void *, size_t, size_t)				   //
+)
+{
+	*samples = realloc_func(*samples, *samples_sz, *samples_sz + sample_sz);
+	*sizes = realloc_func(*sizes, *nsamples * sizeof(size_t), (*nsamples + 1) * sizeof(size_t));
+	memcpy(*samples + *samples_sz, sample, sample_sz);
+	(*sizes)[(*nsamples)++] = sample_sz;
+	*samples_sz += sample_sz;
+}
+
+// train a dictionary of dict_cap bytes from the encoded values. the samples
+// are the bitstreams before zstd: every block of a series, or the whole value
+// compressed as a single frame.
+int _zstd_dictionary_train(
+    unsigned char **inputs, size_t *input_sizes, size_t n, //
+    size_t dict_cap,					   //
+    unsigned char **output, size_t *output_sz,		   //
+    void *(*realloc_func)(void *, size_t, size_t)	   //
+)
+{
+	unsigned char *samples = NULL;
+	size_t samples_sz = 0, *sizes = NULL, nsamples = 0;
+
+	for (size_t i = 0; i < n; ++i) {
+		unsigned char *input = inputs[i];
+		size_t input_sz = input_sizes[i];
+
+		// the values after the runs of nulls
+		unsigned char *runs = NULL;
+		size_t runs_sz = 0;
+		uint32_t rows = 0;
+		if (_nulls_exist(input, input_sz) &&
+		    nulls_parse(input, input_sz, &rows, &runs, &runs_sz, &input, &input_sz) != 0)
+			return -1;
+
+		if (zstd_is_frame(input, input_sz)) {
+			unsigned char *sample = NULL;
+			size_t sample_sz = 0;
+			if (_zstd_decode(input, input_sz, &sample, &sample_sz, realloc_func) != 0)
+				return -1;
+
+			zstd_sample_append(&samples, &samples_sz, &sizes, &nsamples, sample, sample_sz, realloc_func);
+			continue;
+		}
+
+		if (input_sz == 0 || (input[0] & (TE_VER_MASK | TE___D_MASK)) != (TE_VER1 | TE_DI8))
+			continue; // not compressed, or not a series of int8
+
+		U8Decoder d;
+		if (u8_decoder_init(&d, input, input_sz, realloc_func) != 0)
+			return -1;
+
+		for (uint32_t b = 0; b < d.nblocks; ++b) {
+			if (u8_decoder_load_block(&d, b) != 0)
+				return -1;
+
+			BitStream *bs = &d.reader.bs;
+			zstd_sample_append(
+			    &samples, &samples_sz, &sizes, &nsamples, bs->buffer, bs->buffer_size, realloc_func);
+		}
+	}
+
+	*output = realloc_func(NULL, 0, dict_cap);
+	size_t dict_sz = ZDICT_trainFromBuffer(*output, dict_cap, samples, sizes, nsamples);
+	if (ZDICT_isError(dict_sz))
+		return -1;
+
+	*output_sz = dict_sz;
+	return 0;
+}
+
+// the position of the first value > v, or >= v if not upper, of a sorted
+// series. the bound is in the last block whose first value is before it, or at
+// the start of the next block, so only that block is decoded.
+static int u8_decoder_bound(U8Decoder *d, int64_t v, bool upper, size_t *position)
+{
+	size_t block_start = 0, block_end = d->count;
+	bool found = d->nblocks == 0; // the format without blocks is a single block
+	for (uint32_t b = 0, start = 0; b < d->nblocks; ++b) {
+		BlockIndex entry;
+		memcpy(&entry, d->index + b * sizeof(BlockIndex), sizeof(BlockIndex));
+		if (upper ? (int64_t)entry.first > v : (int64_t)entry.first >= v)
+			break;
+
+		block_start = start, block_end = start + entry.count, found = true;
+		start += entry.count;
+	}
+
+	*position = 0;
+	if (!found)
+		return 0;
+
+	if (u8_decoder_seek_values(d, block_start) != 0)
+		return -1;
+
+	uint64_t values[128];
+	for (size_t p = block_start, n; p < block_end; p += n) {
+		n = u8_block_read(&d->reader, values, block_end - p < 128 ? block_end - p : 128);
+		if (n == 0)
+			return -1;
+
+		for (size_t i = 0; i < n; ++i) {
+			if (upper ? (int64_t)values[i] > v : (int64_t)values[i] >= v) {
+				*position = p + i;
+				return 0;
+			}
+		}
+	}
+
+	*position = block_end;
+	return 0;
+}
+
+int _u8_series_search(
+    unsigned char *input, size_t input_sz,	  //
+    int64_t lo, int64_t hi,			  //
+    size_t *start, size_t *count,		  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	// the positions are of the values with nulls
+	U8Decoder d;
+	if (u8_decoder_init(&d, input, input_sz, realloc_func) != 0 || d.runs != NULL)
+		return -1;
+
+	size_t end = 0;
+	if (u8_decoder_bound(&d, lo, false, start) != 0 || u8_decoder_bound(&d, hi, true, &end) != 0)
+		return -1;
+
+	*count = end > *start ? end - *start : 0;
+	return 0;
+}
+
+// the aggregates of a series, computed block by block in the decode loop, no
+// output array is built.
+
+// the sum of a block from the delta of delta without rebuilding the values:
+//
+//   sum(v) = n*v0 + delta*n(n-1)/2 + sum(dd[j] * (n-j)(n-j+1)/2), j in [2, n)
+//
+// it is exact only when no value wraps around int64, which is guaranteed when
+// v0 is in (-2^62, 2^62), delta in (-2^31, 2^31), every dd is in [-2^32, 2^32]
+// and n <= TE_BLOCK_SIZE. returns false if the block does not fit.
+static bool u8_block_sum_fast(U8BlockReader r, __int128 *sum)
+{
+	if (r.type != TE_DI8 && r.type != TE_LIN)
+		return false;
+
+	int64_t n = r.count, first = r.last, delta = r.delta;
+	if (n > TE_BLOCK_SIZE || first <= -(1LL << 62) || first >= (1LL << 62) || delta <= INT32_MIN || delta >= INT32_MAX)
+		return false;
+
+	__int128 s = (__int128)n * first + (__int128)delta * (n * (n - 1) / 2);
+
+	uint64_t dd[128], big = 0;
+	for (int64_t j = 2; r.type == TE_DI8 && j < n;) {
+		int64_t m = n - j < 128 ? n - j : 128;
+		u8_read_double_deltas(&r.bs, dd, m);
+
+		for (int64_t k = 0; k < m; ++k, ++j) {
+			s += (__int128)(int64_t)dd[k] * ((n - j) * (n - j + 1) / 2);
+			big |= (dd[k] + (1ULL << 32)) >> 33;
+		}
+	}
+
+	if (big != 0)
+		return false;
+
+	*sum = s;
+	return true;
+}
+
+// the count and the first value from a prefix of the series, the header and
+// the first entry of the index. returns the size of the header and the whole
+// index, -1 if the prefix is too short or the input is not a blocked series.
+int _u8_series_prefix(unsigned char *input, size_t input_sz, uint32_t *count, uint64_t *first)
+{
+	uint32_t nblocks = 0;
+	int header_sz = series_read_header(input, input_sz, count, &nblocks);
+	if (header_sz < 0 || (nblocks > 0 && input_sz < header_sz + sizeof(BlockIndex)))
+		return -1;
+
+	BlockIndex entry = {0};
+	if (nblocks > 0)
+		memcpy(&entry, input + header_sz, sizeof(BlockIndex));
+
+	*first = entry.first;
+	return header_sz + nblocks * sizeof(BlockIndex);
+}
+
+// the offset of the payload of the last block from the beginning of the series,
+// the input is the header and the index
+int _u8_series_tail(unsigned char *input, size_t input_sz, size_t *offset)
+{
+	uint32_t count = 0, nblocks = 0;
+	int header_sz = series_read_header(input, input_sz, &count, &nblocks);
+	if (header_sz < 0 || nblocks == 0 || (input_sz - header_sz) / sizeof(BlockIndex) < nblocks)
+		return -1;
+
+	BlockIndex entry;
+	memcpy(&entry, input + header_sz + (nblocks - 1) * sizeof(BlockIndex), sizeof(BlockIndex));
+	*offset = header_sz + nblocks * sizeof(BlockIndex) + entry.offset;
+	return 0;
+}
+
+// the last value from the index and the payload of the last block, only the
+// last block is decoded
+int _u8_series_last(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char *tail, size_t tail_sz,	  //
+    uint64_t *last,				  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	U8Decoder d;
+	if (zstd_is_frame(input, input_sz) || u8_decoder_init(&d, input, input_sz, realloc_func) != 0 || d.nblocks == 0)
+		return -1;
+
+	// the last block is the only block of the decoder
+	BlockIndex entry;
+	memcpy(&entry, d.index + (d.nblocks - 1) * sizeof(BlockIndex), sizeof(BlockIndex));
+	entry.offset = 0;
+	d.index = (unsigned char *)&entry, d.nblocks = 1, d.count = entry.count;
+	d.blocks = tail, d.blocks_sz = tail_sz;
+
+	size_t n = 0;
+	if (entry.count == 0 || _u8_decoder_seek(&d, entry.count - 1) != 0 || _u8_decoder_read(&d, last, 1, &n) != 0)
+		return -1;
+
+	return n == 1 ? 0 : -1;
+}
+
+// the count is read from the header, no block is decompressed
+int _u8_series_count(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t *count,				  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	U8Decoder d;
+	if (u8_decoder_init(&d, input, input_sz, realloc_func) != 0)
+		return -1;
+
+	*count = d.count;
+	return 0;
+}
+
+int _u8_series_sum(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t *count, __int128 *sum,		  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	U8Decoder d;
+	if (u8_decoder_init(&d, input, input_sz, realloc_func) != 0)
+		return -1;
+
+	*count = d.count, *sum = 0;
+
+	// the format without blocks is a single block, it is ready in the reader
+	for (uint32_t b = 0; b == 0 || b < d.nblocks; ++b) {
+		if (d.nblocks > 0 && u8_decoder_load_block(&d, b) != 0)
+			return -1;
+
+		__int128 s = 0;
+		if (u8_block_sum_fast(d.reader, &s)) {
+			*sum += s;
+			continue;
+		}
+
+		// some value may wrap around, sum the rebuilt values
+		uint64_t values[128];
+		for (size_t n; (n = u8_block_read(&d.reader, values, 128)) > 0;) {
+			for (size_t i = 0; i < n; ++i)
+				s += (int64_t)values[i];
+		}
+
+		*sum += s;
+	}
+
+	return 0;
+}
+
+// min and max are not set if the series is empty
+int _u8_series_min_max(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t *count, int64_t *min, int64_t *max,  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	U8Decoder d;
+	if (u8_decoder_init(&d, input, input_sz, realloc_func) != 0)
+		return -1;
+
+	*count = d.count;
+	if (d.count == 0)
+		return 0;
+
+	int64_t lo = INT64_MAX, hi = INT64_MIN;
+
+	for (uint32_t b = 0; b == 0 || b < d.nblocks; ++b) {
+		if (d.nblocks > 0 && u8_decoder_load_block(&d, b) != 0)
+			return -1;
+
+		uint64_t values[128];
+		for (size_t n; (n = u8_block_read(&d.reader, values, 128)) > 0;) {
+			for (size_t i = 0; i < n; ++i) {
+				int64_t v = values[i];
+				lo = v < lo ? v : lo;
+				hi = v > hi ? v : hi;
+			}
+		}
+	}
+
+	*min = lo, *max = hi;
+	return 0;
+}
+
+// the rollup of a series over the buckets of its timestamps. the decoders of
+// ctime and val are read in lockstep by batches, the values of a bucket are
+// aggregated while its timestamps are in [start, start + width), so a bucket
+// ends at the first timestamp out of it and ctime must be sorted to have one
+// bucket per start. the nulls of val are skipped.
+struct U8Bucketer {
+	U8Decoder ctime, val;
+	int64_t width;
+
+	size_t n, i; // the values of the batch, the next one
+	uint64_t ctimes[128], vals[128];
+	bool nulls[128];
+};
+
+// the start of the bucket of t, aligned to 0
+static inline int64_t bucket_start(int64_t t, int64_t width)
+{
+	int64_t r = t % width;
+	return t - (r < 0 ? r + width : r);
+}
+
+U8Bucketer *_u8_bucketer_create(
+    unsigned char *ctime, size_t ctime_sz,	   //
+    unsigned char *val, size_t val_sz,		   //
+    int64_t width,				   //
+    void *(*realloc_func)(void *, size_t, size_t), //
+    void (*free_func)(void *)			   //
+)
+{
+	U8Bucketer *b = realloc_func(NULL, 0, sizeof(U8Bucketer));
+	*b = (U8Bucketer){.width = width};
+
+	if (width <= 0 || u8_decoder_init(&b->ctime, ctime, ctime_sz, realloc_func) != 0 ||
+	    u8_decoder_init(&b->val, val, val_sz, realloc_func) != 0 || b->ctime.runs != NULL ||
+	    _u8_decoder_count(&b->ctime) != _u8_decoder_count(&b->val)) {
+		_u8_bucketer_free(b, free_func);
+		return NULL;
+	}
+
+	return b;
+}
+
+void _u8_bucketer_free(U8Bucketer *b, void (*free_func)(void *))
+{
+	void *buffers[] = {b->ctime.scratch, b->val.scratch, b};
+	for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); ++i) {
+		if (buffers[i] != NULL)
+			free_func(buffers[i]);
+	}
+}
+
+int _u8_bucketer_next(U8Bucketer *b, TimeBucket *bucket)
+{
+	bool open = false;
+	while (true) {
+		if (b->i == b->n) {
+			size_t n = 0;
+			if (_u8_decoder_read(&b->ctime, b->ctimes, 128, &b->n) != 0 ||
+			    _u8_decoder_read_nulls(&b->val, b->vals, b->nulls, b->n, &n) != 0 || n != b->n)
+				return -1;
+
+			b->i = 0;
+			if (b->n == 0)
+				return open;
+		}
+
+		if (!open) {
+			*bucket = (TimeBucket){.start = bucket_start(b->ctimes[b->i], b->width)};
+			bucket->min = INT64_MAX, bucket->max = INT64_MIN, open = true;
+		}
+
+		// the timestamps of the bucket in the batch, a timestamp before the
+		// start wraps around to a large offset
+		uint64_t start = bucket->start, width = b->width;
+		int64_t first = bucket->first, last = bucket->last, min = bucket->min, max = bucket->max;
+		uint32_t count = bucket->count;
+		__int128 sum = bucket->sum;
+
+		size_t i = b->i;
+		for (; i < b->n && b->ctimes[i] - start < width; ++i) {
+			if (b->nulls[i])
+				continue;
+
+			int64_t v = b->vals[i];
+			first = count == 0 ? v : first;
+			last = v, sum += v, count++;
+			min = v < min ? v : min;
+			max = v > max ? v : max;
+		}
+
+		bucket->first = first, bucket->last = last, bucket->min = min, bucket->max = max;
+		bucket->count = count, bucket->sum = sum;
+
+		b->i = i;
+		if (i < b->n)
+			return 1;
+	}
+}
+
+// the row group, the encoded columns of one archived row share one value. the
+// directory is at the beginning, so a reader of one column only needs the
+// prefix of the value and the bytes of that column.
+//
+// binary format:
+//   [[1-3bytes], [2bytes],   [RowGroupColumn * ncolumns], [column * ncolumns]]
+//    ^ count     ^ ncolumns  ^ the directory              ^ the encoded columns as returned by the encoders
+
+typedef struct __attribute__((packed)) RowGroupColumn {
+	uint32_t type;	 // the type of the column, opaque to the codec
+	uint32_t offset; // the offset of the column from the beginning of the row group
+	uint32_t size;	 // the size of the encoded column
+} RowGroupColumn;
+
+int _rowgroup_encode(
+    uint32_t count, uint16_t ncolumns,		   //
+    unsigned char **columns, size_t *column_sizes, //
+    uint32_t *types,				   //
+    unsigned char **output, size_t *output_sz,	   //
+    void *(*realloc_func)(void *, size_t, size_t)  //
+)
+{
+	if (count > 0xFFFFFF)
+		return -1; // will overflow
+
+	unsigned char header[U8_HEADER_MAX_SZ];
+	u8_write_header(header, count, 0, 0);
+	header[0] = (header[0] & ~(TE_VER_MASK | TE___D_MASK)) | TE_VER2 | TE_RGP;
+	int header_sz = series_header_size(count) - 4;
+
+	size_t directory_sz = header_sz + 2 + ncolumns * sizeof(RowGroupColumn), sz = directory_sz;
+	for (uint16_t i = 0; i < ncolumns; ++i)
+		sz += column_sizes[i];
+
+	if (sz > UINT32_MAX)
+		return -1;
+
+	*output = realloc_func(NULL, 0, sz);
+	*output_sz = sz;
+
+	unsigned char *o = *output;
+	memcpy(o, header, header_sz);
+	memcpy(o + header_sz, &ncolumns, 2);
+
+	size_t offset = directory_sz;
+	for (uint16_t i = 0; i < ncolumns; ++i) {
+		RowGroupColumn c = {.type = types[i], .offset = offset, .size = column_sizes[i]};
+		memcpy(o + header_sz + 2 + i * sizeof(RowGroupColumn), &c, sizeof(RowGroupColumn));
+		memcpy(o + offset, columns[i], column_sizes[i]);
+		offset += column_sizes[i];
+	}
+
+	return 0;
+}
+
+// the size of the header and the directory, read from the first
+// ROWGROUP_PREFIX_SZ bytes. -1 if the input is not a row group
+int _rowgroup_directory_size(unsigned char *input, size_t input_sz, uint32_t *count, uint16_t *ncolumns)
+{
+	int header_sz = header_read(input, input_sz, TE_VER2, TE_RGP, count);
+	if (header_sz < 0 || input_sz < (size_t)header_sz + 2)
+		return -1;
+
+	memcpy(ncolumns, input + header_sz, 2);
+	return header_sz + 2 + *ncolumns * sizeof(RowGroupColumn);
+}
+
+// the position of a column, the input only needs to hold the directory
+int _rowgroup_column(
+    unsigned char *input, size_t input_sz,	 //
+    uint16_t column,				 //
+    uint32_t *type, size_t *offset, size_t *size //
+)
+{
+	uint32_t count = 0;
+	uint16_t ncolumns = 0;
+	int directory_sz = _rowgroup_directory_size(input, input_sz, &count, &ncolumns);
+	if (directory_sz < 0 || input_sz < (size_t)directory_sz || column >= ncolumns)
+		return -1;
+
+	RowGroupColumn c;
+	memcpy(&c, input + directory_sz - (ncolumns - column) * sizeof(RowGroupColumn), sizeof(RowGroupColumn));
+	if (c.offset < (uint32_t)directory_sz)
+		return -1;
+
+	*type = c.type, *offset = c.offset, *size = c.size;
 	return 0;
 }
 
+// the gorilla XOR encoded for float datatype
+//
+// binary format:
+//   [[1-3bytes], [8bytes],          [bit stream]]
+//    ^ count     ^ the first value  ^ the real data
+//
+// bitstream format:
+//   xor = value[i] ^ value[i-1], the meaningful bits is xor without the leading and trailing zeros
+//     0b0   = xor is 0, value is equal with previous value
+//     0b10  = meaningful bits fit in the previous window. value = window bits
+//     0b11  = new window: [5 bits leading zeros][6 bits meaningful length, 0 is 64] + meaningful bits
 int _f8_encode(
-    float64_t *input, size_t input_sz,	       //
-    unsigned char **output, size_t *output_sz, //
-    void *(*alloc_func)(size_t, size_t)	       //
+    float64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
 )
 {
+	// encoding type = float64_t
+	uint8_t header = TE_VER | TE_DF8;
+
+	// set output size
+	uint8_t output_len_size = 0;
+	if (input_sz > 0xFFFFFF)
+		return -1; // will overflow
+	else if (input_sz > 0x00FFFF)
+		header |= TE_SZ3, output_len_size = 3;
+	else if (input_sz > 0x0000FF)
+		header |= TE_SZ2, output_len_size = 2;
+	else
+		header |= TE_SZ1, output_len_size = 1;
+
+	// alloc memory, 2 + 5 + 6 + 64 bits for each value in the worst case
+	*output_sz = 1 /* header */ + output_len_size /* length */ + input_sz * 10 /* value */;
+	*output = realloc_func(NULL, 0, *output_sz);
+	unsigned char *output_buffer = *output;
+
+	// write the header out
+	output_buffer[0] = header;
+	output_buffer += 1;
+
+	// write out the input count
+	uint32_t input_entity_size = input_sz;
+	memcpy(output_buffer, &input_entity_size, output_len_size);
+	output_buffer += output_len_size;
+
+	if (input_entity_size == 0) {
+		*output_sz = 1 + output_len_size;
+		return 0;
+	}
+
+	// write out the first value
+	uint64_t last = 0;
+	memcpy(&last, input, 8);
+	memcpy(output_buffer, &last, 8);
+	output_buffer += 8;
+
+	// the window of meaningful bits, no window at begin
+	uint8_t window_leading = 0xFF, window_trailing = 0;
+
+	BitStream bs = bitstream_create(output_buffer, *output_sz - (output_buffer - *output), 0);
+	for (size_t i = 1; i < input_entity_size; ++i) {
+		uint64_t value = 0;
+		memcpy(&value, input + i, 8);
+
+		uint64_t xor = value ^ last;
+		last = value;
+
+		if (xor == 0) {
+			bitstream_write_bit_n(&bs, 0b0, 1);
+			continue;
+		}
+
+		uint8_t leading = __builtin_clzll(xor), trailing = __builtin_ctzll(xor);
+		leading = leading > 31 ? 31 : leading; // 5 bits
+
+		if (leading >= window_leading && trailing >= window_trailing) {
+			bitstream_write_bit_n(&bs, 0b10, 2);
+			bitstream_write_bit_n(&bs, xor >> window_trailing, 64 - window_leading - window_trailing);
+			continue;
+		}
+
+		uint8_t meaningful = 64 - leading - trailing;
+		bitstream_write_bit_n(&bs, 0b11 << 11 | leading << 6 | (meaningful & 0b111111), 13);
+		bitstream_write_bit_n(&bs, xor >> trailing, meaningful);
+		window_leading = leading, window_trailing = trailing;
+	}
+
+	bitstream_flush(&bs);
+	*output_sz = bs.buffer_offset_current + 1 + output_len_size + 8;
 	return 0;
 }
 
 int _f8_decode(
-    float64_t *input, size_t input_sz,	       //
-    unsigned char **output, size_t *output_sz, //
-    void *(*alloc_func)(size_t, size_t)	       //
+    unsigned char *input, size_t input_sz,	  //
+    float64_t **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	uint32_t output_entity_num = 0;
+	int header_sz = header_read(input, input_sz, TE_VER, TE_DF8, &output_entity_num);
+	if (header_sz < 0 || (output_entity_num > 0 && input_sz < (size_t)header_sz + 8))
+		return -1;
+
+	input += header_sz;
+
+	// alloc memory
+	*output_sz = output_entity_num * 8;
+	*output = realloc_func(NULL, 0, *output_sz);
+
+	if (output_entity_num == 0)
+		return 0;
+
+	// the first value
+	uint64_t last = 0;
+	memcpy(&last, input, 8);
+	memcpy(*output, &last, 8);
+	input += 8;
+
+	uint8_t window_leading = 0, window_trailing = 0;
+
+	BitStream bs = bitstream_create(input, input_sz - header_sz - 8, 0);
+	for (size_t i = 1; i < output_entity_num; ++i) {
+		uint64_t word = bitstream_peek_word(&bs);
+
+		if ((word >> 63) == 0b0) {
+			bs.buffer_offset_current += 1;
+		} else if ((word >> 62) == 0b10) {
+			bs.buffer_offset_current += 2;
+			uint8_t meaningful = 64 - window_leading - window_trailing;
+			last ^= bitstream_read_long_n(&bs, meaningful) << window_trailing;
+		} else {
+			window_leading = (word >> 57) & 0b11111;
+			uint8_t meaningful = (word >> 51) & 0b111111;
+			meaningful = meaningful == 0 ? 64 : meaningful;
+			if (window_leading + meaningful > 64)
+				return -1; // the window is wider than the value
+
+			window_trailing = 64 - window_leading - meaningful;
+
+			bs.buffer_offset_current += 13;
+			last ^= bitstream_read_long_n(&bs, meaningful) << window_trailing;
+		}
+
+		memcpy(*output + i, &last, 8);
+	}
+
+	return 0;
+}
+
+// the decimal series of float8. most gauges are decimals with a few digits, so
+// each block finds the exponent e and the factor f which turn its doubles into
+// integers without loss, n = round(v * 10^e / 10^f), and the integers are
+// written as the blocked series of int8. the values which do not round trip
+// (NaN, -0.0, more digits) are exceptions, stored as they are.
+//
+// binary format:
+//   [[1-3bytes], [4bytes],          [[1byte], [1byte], [2bytes], [[2bytes], [8bytes]] * exceptions] * blocks, [series]]
+//    ^ count     ^ size of blocks   ^ e       ^ f      ^ count    ^ position ^ the value                  ^ of n
+//
+// the blocks are TE_BLOCK_SIZE values as in the series, the integer of an
+// exception is the integer before it, so it does not break a run or a delta.
+// values which are not decimals are stored as the gorilla XOR of _f8_encode
+// compressed by the second stage.
+
+#define F8_EXPONENT_MAX 18
+#define F8_SAMPLES 32	     /* values of a block tried with each exponent */
+#define F8_EXCEPTION_RATIO 8 /* the decimal series is kept when less than 1/8 of the values are exceptions */
+
+static const float64_t f8_pow10[F8_EXPONENT_MAX + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+};
+
+// the encoder checks the value with the same expression as the decoder, so
+// every value which is not an exception decodes to the same bits
+static inline float64_t f8_decimal_value(int64_t n, uint8_t e, uint8_t f)
+{
+	return (float64_t)n * f8_pow10[f] / f8_pow10[e];
+}
+
+static inline bool f8_decimal_encode(float64_t v, uint8_t e, uint8_t f, int64_t *n)
+{
+	float64_t scaled = v * f8_pow10[e] / f8_pow10[f];
+	if (!(fabs(scaled) < 0x1p51)) // NaN, inf, or more than the integer part of a double
+		return false;
+
+	// round to the nearest, the magic number leaves the integer in the mantissa
+	const float64_t magic = 0x1p52 + 0x1p51;
+	*n = (int64_t)((scaled + magic) - magic);
+
+	float64_t d = f8_decimal_value(*n, e, f);
+	return memcmp(&d, &v, 8) == 0;
+}
+
+static size_t f8_decimal_exceptions(float64_t *values, size_t n, uint8_t e, uint8_t f)
+{
+	size_t step = n < F8_SAMPLES ? 1 : n / F8_SAMPLES, exceptions = 0;
+	for (size_t i = 0; i < n; i += step) {
+		int64_t x;
+		exceptions += !f8_decimal_encode(values[i], e, f, &x);
+	}
+
+	return exceptions;
+}
+
+// the smallest exponent with the fewest exceptions in the samples, then the
+// largest factor which does not add an exception
+static void f8_decimal_plan(float64_t *values, size_t n, uint8_t *e, uint8_t *f)
+{
+	size_t best = SIZE_MAX;
+	for (uint8_t i = 0; i <= F8_EXPONENT_MAX && best > 0; ++i) {
+		size_t exceptions = f8_decimal_exceptions(values, n, i, 0);
+		if (exceptions < best)
+			best = exceptions, *e = i;
+	}
+
+	*f = 0;
+	for (uint8_t i = 1; i <= *e; ++i) {
+		if (f8_decimal_exceptions(values, n, *e, i) <= best)
+			*f = i;
+	}
+}
+
+// the scratch never reaches the caller, it is allocated by libc and freed on
+// return since realloc_func can not free
+static void *scratch_realloc(void *p, size_t old_sz __attribute__((unused)), size_t new_sz)
+{
+	return realloc(p, new_sz);
+}
+
+// the series is written after offset bytes of the output, which are left for
+// the caller
+static int f8_series_write(
+    float64_t *input, size_t input_sz,		  //
+    uint32_t dictionary,			  //
+    size_t offset,				  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	int header_sz = series_header_size(input_sz);
+	if (header_sz < 0)
+		return -1; // will overflow
+
+	header_sz -= 4; // the count only, the series of n has its own header
+
+	size_t nblocks = (input_sz + TE_BLOCK_SIZE - 1) / TE_BLOCK_SIZE, exceptions = 0;
+	size_t params_sz = 0, params_cap = nblocks * 4 + 64;
+	unsigned char *params = malloc(params_cap), *bitstream = NULL;
+	uint64_t *ints = malloc(input_sz * 8 + 8);
+	int ret = -1;
+	if (params == NULL || ints == NULL)
+		goto out;
+
+	for (size_t b = 0; b < nblocks; ++b) {
+		float64_t *values = input + b * TE_BLOCK_SIZE;
+		size_t n = input_sz - b * TE_BLOCK_SIZE;
+		n = n < TE_BLOCK_SIZE ? n : TE_BLOCK_SIZE;
+
+		uint8_t e = 0, f = 0;
+		f8_decimal_plan(values, n, &e, &f);
+
+		size_t block_params = params_sz;
+		params[params_sz++] = e, params[params_sz++] = f;
+		params_sz += 2;
+
+		uint16_t block_exceptions = 0;
+		int64_t last = 0;
+		for (size_t i = 0; i < n; ++i) {
+			int64_t x;
+			if (f8_decimal_encode(values[i], e, f, &x)) {
+				ints[b * TE_BLOCK_SIZE + i] = last = x;
+				continue;
+			}
+
+			ints[b * TE_BLOCK_SIZE + i] = last;
+
+			if (params_cap < params_sz + 10 + (nblocks - b) * 4) {
+				size_t new_cap = params_cap * 2 + 10;
+				unsigned char *grown = realloc(params, new_cap);
+				if (grown == NULL)
+					goto out;
+
+				params = grown, params_cap = new_cap;
+			}
+
+			uint16_t position = i;
+			memcpy(params + params_sz, &position, 2);
+			memcpy(params + params_sz + 2, values + i, 8);
+			params_sz += 10, block_exceptions++;
+		}
+
+		memcpy(params + block_params + 2, &block_exceptions, 2);
+		exceptions += block_exceptions;
+	}
+
+	// the values are not decimals, the gorilla XOR is smaller
+	if (exceptions > input_sz / F8_EXCEPTION_RATIO) {
+		size_t bitstream_sz = 0;
+		if (_f8_encode(input, input_sz, &bitstream, &bitstream_sz, scratch_realloc) != 0 ||
+		    _zstd_encode_adaptive(bitstream, bitstream_sz, dictionary, output, output_sz, realloc_func) != 0)
+			goto out;
+
+		if (offset > 0) {
+			*output = realloc_func(*output, *output_sz, *output_sz + offset);
+			memmove(*output + offset, *output, *output_sz);
+			*output_sz += offset;
+		}
+
+		ret = 0;
+		goto out;
+	}
+
+	size_t prefix_sz = offset + header_sz + 4 + params_sz;
+	if (u8_series_write(ints, input_sz, dictionary, prefix_sz, output, output_sz, realloc_func) != 0)
+		goto out;
+
+	unsigned char header[U8_HEADER_MAX_SZ];
+	u8_write_header(header, input_sz, 0, 0);
+	header[0] = (header[0] & ~TE_VER_MASK & ~TE___D_MASK) | TE_VER1 | TE_DF8;
+
+	uint32_t params_size = params_sz;
+	memcpy(*output + offset, header, header_sz);
+	memcpy(*output + offset + header_sz, &params_size, 4);
+	memcpy(*output + offset + header_sz + 4, params, params_sz);
+	ret = 0;
+
+out:
+	free(params), free(ints), free(bitstream);
+	return ret;
+}
+
+int _f8_series_encode_dict(
+    float64_t *input, size_t input_sz,		  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	return f8_series_write(input, input_sz, dictionary, 0, output, output_sz, realloc_func);
+}
+
+// the values which are not null are written as _f8_series_encode_dict, the
+// runs are written as _u8_series_encode_nulls
+int _f8_series_encode_nulls(
+    float64_t *input,				  //
+    uint8_t *validity, size_t count,		  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	if (validity == NULL)
+		return f8_series_write(input, count, dictionary, 0, output, output_sz, realloc_func);
+
+	int header_sz = series_header_size(count);
+	if (header_sz < 0)
+		return -1; // will overflow
+
+	size_t nvalid = 0, runs_sz = nulls_runs_write(validity, count, NULL, &nvalid);
+	if (nvalid == count)
+		return f8_series_write(input, count, dictionary, 0, output, output_sz, realloc_func);
+
+	if (f8_series_write(input, nvalid, dictionary, header_sz + runs_sz, output, output_sz, realloc_func) != 0)
+		return -1;
+
+	nulls_write_header(*output, TE_DF8, count, runs_sz);
+	nulls_runs_write(validity, count, *output + header_sz, &nvalid);
+	return 0;
+}
+
+int _f8_series_encode(
+    float64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	return _f8_series_encode_dict(input, input_sz, 0, output, output_sz, realloc_func);
+}
+
+int _f8_series_decode(
+    unsigned char *input, size_t input_sz,	  //
+    float64_t **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	// the values with nulls are split by _nulls_read first
+	if (_nulls_exist(input, input_sz))
+		return -1;
+
+	uint32_t count = 0;
+	int header_sz = header_read(input, input_sz, TE_VER1, TE_DF8, &count);
+	if (header_sz < 0) {
+		// the gorilla XOR, compressed or not
+		unsigned char *bitstream = NULL;
+		size_t bitstream_sz = 0;
+		if (_zstd_decode_adaptive(input, input_sz, &bitstream, &bitstream_sz, realloc_func) != 0)
+			return -1;
+
+		return _f8_decode(bitstream, bitstream_sz, output, output_sz, realloc_func);
+	}
+
+	uint32_t params_sz = 0;
+	if (input_sz < (size_t)header_sz + 4)
+		return -1;
+
+	memcpy(&params_sz, input + header_sz, 4);
+	unsigned char *params = input + header_sz + 4;
+	if (input_sz - header_sz - 4 < params_sz)
+		return -1;
+
+	// the integers are decoded in place of the doubles
+	unsigned char *series = params + params_sz;
+	if (_u8_series_decode(series, input + input_sz - series, (uint64_t **)output, output_sz, realloc_func) != 0 ||
+	    *output_sz != (size_t)count * 8)
+		return -1;
+
+	size_t offset = 0;
+	for (size_t b = 0; b * TE_BLOCK_SIZE < count; ++b) {
+		float64_t *values = *output + b * TE_BLOCK_SIZE;
+		size_t n = count - b * TE_BLOCK_SIZE;
+		n = n < TE_BLOCK_SIZE ? n : TE_BLOCK_SIZE;
+
+		if (params_sz < offset + 4)
+			return -1;
+
+		uint8_t e = params[offset], f = params[offset + 1];
+		uint16_t exceptions = 0;
+		memcpy(&exceptions, params + offset + 2, 2);
+		offset += 4;
+
+		if (e > F8_EXPONENT_MAX || f > e || params_sz < offset + exceptions * 10)
+			return -1;
+
+		for (size_t i = 0; i < n; ++i) {
+			int64_t x;
+			memcpy(&x, values + i, 8);
+			values[i] = f8_decimal_value(x, e, f);
+		}
+
+		for (uint16_t i = 0; i < exceptions; ++i, offset += 10) {
+			uint16_t position = 0;
+			memcpy(&position, params + offset, 2);
+			if (position >= n)
+				return -1;
+
+			memcpy(values + position, params + offset + 2, 8);
+		}
+	}
+
+	return offset == params_sz ? 0 : -1;
+}
+
+// the streaming decoder of the float8 series is the decoder of its integers,
+// the parameters of a block are read when the position enters it. the gorilla
+// XOR has no blocks, it is decoded as a whole by the first read.
+static int f8_decoder_next_block(U8Decoder *d)
+{
+	if (d->params_sz < d->params_read + 4)
+		return -1;
+
+	unsigned char *block = d->params + d->params_read;
+	d->e = block[0], d->f = block[1];
+	memcpy(&d->exceptions, block + 2, 2);
+	d->params_read += 4 + d->exceptions * 10;
+	if (d->e > F8_EXPONENT_MAX || d->f > d->e || d->params_sz < d->params_read)
+		return -1;
+
+	d->block_end += TE_BLOCK_SIZE;
+	return 0;
+}
+
+static int f8_decoder_read_values(U8Decoder *d, uint64_t *output, size_t n, size_t *output_n)
+{
+	n = n < d->count - d->position ? n : d->count - d->position;
+
+	if (d->params == NULL) {
+		memcpy(output, d->doubles + d->position, n * 8);
+		d->position += n, *output_n = n;
+		return 0;
+	}
+
+	for (size_t total = 0, m, read; total < n; total += m) {
+		if (d->position == d->block_end && f8_decoder_next_block(d) != 0)
+			return -1;
+
+		m = n - total < d->block_end - d->position ? n - total : d->block_end - d->position;
+		if (u8_decoder_read_values(d, output + total, m, &read) != 0 || read != m)
+			return -1;
+
+		for (size_t i = 0; i < m; ++i) {
+			float64_t v = f8_decimal_value(output[total + i], d->e, d->f);
+			memcpy(output + total + i, &v, 8);
+		}
+
+		// the exceptions of the block which are in the batch
+		size_t first = d->position - (d->block_end - TE_BLOCK_SIZE);
+		unsigned char *exception = d->params + d->params_read - d->exceptions * 10;
+		for (uint16_t i = 0; i < d->exceptions; ++i, exception += 10) {
+			uint16_t position = 0;
+			memcpy(&position, exception, 2);
+			if (position >= first && position < first + m)
+				memcpy(output + total + position - first, exception + 2, 8);
+		}
+
+		d->position += m;
+	}
+
+	*output_n = n;
+	return 0;
+}
+
+static int f8_decoder_seek_values(U8Decoder *d, size_t position)
+{
+	d->position = position < d->count ? position : d->count;
+	if (d->params == NULL)
+		return 0;
+
+	// the parameters are walked up to the block of the position
+	d->params_read = 0, d->block_end = 0;
+	while (d->block_end <= d->position && d->block_end < d->count) {
+		if (f8_decoder_next_block(d) != 0)
+			return -1;
+	}
+
+	return u8_decoder_seek_values(d, d->position);
+}
+
+static int f8_decoder_init_values(
+    U8Decoder *d, unsigned char *input, size_t input_sz, //
+    void *(*realloc_func)(void *, size_t, size_t)	 //
 )
 {
+	uint32_t count = 0;
+	int header_sz = header_read(input, input_sz, TE_VER1, TE_DF8, &count);
+	if (header_sz < 0) {
+		*d = (U8Decoder){.realloc_func = realloc_func};
+
+		size_t doubles_sz = 0;
+		if (_f8_series_decode(input, input_sz, &d->doubles, &doubles_sz, realloc_func) != 0)
+			return -1;
+
+		d->count = doubles_sz / 8;
+	} else {
+		uint32_t params_sz = 0;
+		if (input_sz < (size_t)header_sz + 4)
+			return -1;
+
+		memcpy(&params_sz, input + header_sz, 4);
+		unsigned char *params = input + header_sz + 4;
+		if (input_sz - header_sz - 4 < params_sz)
+			return -1;
+
+		unsigned char *series = params + params_sz;
+		if (u8_decoder_init_values(d, series, input + input_sz - series, realloc_func) != 0 ||
+		    d->count != count)
+			return -1;
+
+		d->params = params, d->params_sz = params_sz;
+	}
+
+	d->read_values = f8_decoder_read_values, d->seek_values = f8_decoder_seek_values;
 	return 0;
 }
+
+U8Decoder *_f8_decoder_create(
+    unsigned char *input, size_t input_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	U8Decoder init;
+	if (u8_decoder_init_rows(&init, input, input_sz, f8_decoder_init_values, realloc_func) != 0)
+		return NULL;
+
+	U8Decoder *d = realloc_func(NULL, 0, sizeof(U8Decoder));
+	*d = init;
+	return d;
+}
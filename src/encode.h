@@ -1,7 +1,10 @@
+#include <stdbool.h>
 #include <stdint.h>
 typedef double float64_t;
 #include <stdlib.h>
 
+#define TE_BLOCK_SIZE 4096 /* values in a block of the blocked series */
+
 int _u8_encode(
     uint64_t *input, size_t input_sz,		  //
     unsigned char **output, size_t *output_sz,	  //
@@ -12,23 +15,262 @@ int _u8_decode(
     uint64_t **output, size_t *output_sz,	  //
     void *(*realloc_func)(void *, size_t, size_t) //
 );
+
+// the blocked series of delta of delta, a slice only decodes the blocks it touches
+int _u8_series_encode(
+    uint64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+int _u8_series_encode_dict(
+    uint64_t *input, size_t input_sz,		  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+int _u8_series_decode(
+    unsigned char *input, size_t input_sz,	  //
+    uint64_t **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+int _u8_series_slice(
+    unsigned char *input, size_t input_sz,	  //
+    size_t start, size_t count,			  //
+    uint64_t **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+// the values with nulls, the validity is the null bitmap of a postgres array
+// (bit set if not null) and the input holds only the values which are not
+// null. the runs of the validity are written in front of the series, a series
+// without nulls is written as usual. the decoders above return -1 when they
+// read a null, _nulls_read splits the value to the bitmap and the values.
+int _u8_series_encode_nulls(
+    uint64_t *input,				  //
+    uint8_t *validity, size_t count,		  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+bool _nulls_exist(unsigned char *input, size_t input_sz);
+int _nulls_read(
+    unsigned char *input, size_t input_sz,    //
+    uint32_t *count, uint32_t *nvalid,	      //
+    uint8_t *validity,			      //
+    unsigned char **values, size_t *values_sz //
+);
+
+// the range [start, start + count) of the values in [lo, hi] of a series sorted
+// in ascending order, only the blocks at the bounds are decoded
+int _u8_series_search(
+    unsigned char *input, size_t input_sz,	  //
+    int64_t lo, int64_t hi,			  //
+    size_t *start, size_t *count,		  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+// aggregates of the series computed while decoding, the sum does not rebuild
+// the values when the delta of delta is small enough. nulls are skipped as by
+// the aggregates of sql.
+int _u8_series_count(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t *count,				  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+int _u8_series_sum(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t *count, __int128 *sum,		  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+int _u8_series_min_max(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t *count, int64_t *min, int64_t *max,  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+// the metadata of the series without reading the blocks. the count and the
+// first value are in the prefix of SERIES_PREFIX_SZ bytes, the last value
+// needs the header, the index and the payload of the last block from the tail
+// offset. -1 if the input is not a blocked series.
+#define SERIES_PREFIX_SZ (1 + 3 + 4 + 25) /* the header and the first entry of the index */
+int _u8_series_prefix(unsigned char *input, size_t input_sz, uint32_t *count, uint64_t *first);
+int _u8_series_tail(unsigned char *input, size_t input_sz, size_t *offset);
+int _u8_series_last(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char *tail, size_t tail_sz,	  //
+    uint64_t *last,				  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+// the rollup of val over the buckets of width of ctime, ctime must be sorted and
+// have no nulls. the buckets start at multiples of width, the buckets without
+// a row are skipped and the nulls of val are not aggregated. next returns 1
+// for a bucket, 0 at the end and -1 if the input is invalid. create returns
+// NULL if the input is invalid, what it allocated is freed by free_func.
+typedef struct TimeBucket {
+	int64_t start;
+	uint32_t count; // the values which are not null, the rest is not set if 0
+	__int128 sum;
+	int64_t min, max, first, last;
+} TimeBucket;
+
+typedef struct U8Bucketer U8Bucketer;
+U8Bucketer *_u8_bucketer_create(
+    unsigned char *ctime, size_t ctime_sz,	   //
+    unsigned char *val, size_t val_sz,		   //
+    int64_t width,				   //
+    void *(*realloc_func)(void *, size_t, size_t), //
+    void (*free_func)(void *)			   //
+);
+void _u8_bucketer_free(U8Bucketer *b, void (*free_func)(void *));
+int _u8_bucketer_next(U8Bucketer *b, TimeBucket *bucket);
+
+// the codec of the blocks of a series. auto picks the smallest codec of each
+// block, pfor packs the deltas in frames of 128 which decode with simd.
+enum { TE_CODEC_AUTO = 0, TE_CODEC_PFOR = 1 };
+void _u8_set_codec(int codec);
+
+// streaming series encoder, the output is the same as _u8_series_encode
+typedef struct U8Encoder U8Encoder;
+U8Encoder *_u8_encoder_create(void *(*realloc_func)(void *, size_t, size_t));
+void _u8_encoder_free(U8Encoder *e, void (*free_func)(void *));
+int _u8_encoder_append(U8Encoder *e, uint64_t value);
+int _u8_encoder_append_n(U8Encoder *e, uint64_t *values, size_t n);
+int _u8_encoder_append_null(U8Encoder *e);
+int _u8_encoder_append_nulls(U8Encoder *e, uint64_t *values, uint8_t *validity, size_t count);
+int _u8_encoder_finish(U8Encoder *e, unsigned char **output, size_t *output_sz);
+
+// continue a finished series, only the last block is encoded again
+U8Encoder *_u8_encoder_open(
+    unsigned char *input, size_t input_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+// the partial encoders of parallel workers, merged in the order of the chunks
+int _u8_encoder_merge(U8Encoder *e, U8Encoder *other);
+int _u8_encoder_serialize(U8Encoder *e, unsigned char **output, size_t *output_sz);
+U8Encoder *_u8_encoder_deserialize(
+    unsigned char *input, size_t input_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+// streaming series decoder, also reads the output of _u8_encode compressed by zstd
+typedef struct U8Decoder U8Decoder;
+U8Decoder *_u8_decoder_create(
+    unsigned char *input, size_t input_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+void _u8_decoder_free(U8Decoder *d, void (*free_func)(void *));
+uint32_t _u8_decoder_count(U8Decoder *d);
+int _u8_decoder_read(U8Decoder *d, uint64_t *output, size_t n, size_t *output_n);
+int _u8_decoder_seek(U8Decoder *d, size_t position);
+
+// nulls[i] is set for a null, whose output is 0. the count and the positions
+// include the nulls.
+int _u8_decoder_read_nulls(U8Decoder *d, uint64_t *output, bool *nulls, size_t n, size_t *output_n);
+
+// the row group, the encoded columns of one row in one value with a directory
+// at the beginning. the type of a column is opaque to the codec.
+#define ROWGROUP_PREFIX_SZ (1 + 3 + 2) /* enough to read the size of the directory */
+int _rowgroup_encode(
+    uint32_t count, uint16_t ncolumns,		   //
+    unsigned char **columns, size_t *column_sizes, //
+    uint32_t *types,				   //
+    unsigned char **output, size_t *output_sz,	   //
+    void *(*realloc_func)(void *, size_t, size_t)  //
+);
+int _rowgroup_directory_size(unsigned char *input, size_t input_sz, uint32_t *count, uint16_t *ncolumns);
+int _rowgroup_column(
+    unsigned char *input, size_t input_sz,	 //
+    uint16_t column,				 //
+    uint32_t *type, size_t *offset, size_t *size //
+);
+
 int _f8_encode(
-    float64_t *input, size_t input_sz,	       //
-    unsigned char **output, size_t *output_sz, //
-    void *(*alloc_func)(size_t, size_t)	       //
+    float64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
 );
 int _f8_decode(
-    float64_t *input, size_t input_sz,	       //
-    unsigned char **output, size_t *output_sz, //
-    void *(*alloc_func)(size_t, size_t)	       //
+    unsigned char *input, size_t input_sz,	  //
+    float64_t **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+// the decimal series of float8, each block is scaled by a power of ten to the
+// blocked series of int8. the values which are not decimals are kept as the
+// gorilla XOR compressed by the second stage, the decoder reads both.
+int _f8_series_encode(
+    float64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+int _f8_series_encode_dict(
+    float64_t *input, size_t input_sz,		  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
 );
+int _f8_series_encode_nulls(
+    float64_t *input,				  //
+    uint8_t *validity, size_t count,		  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+int _f8_series_decode(
+    unsigned char *input, size_t input_sz,	  //
+    float64_t **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+// the streaming decoder of the float8 series, the values read by the functions
+// of U8Decoder are the bits of the doubles
+U8Decoder *_f8_decoder_create(
+    unsigned char *input, size_t input_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+// the second stage compression of the bitstream, zstd is used only when it pays
+enum { TE_STAGE_NONE = 0, TE_STAGE_ZSTD = 1, TE_STAGE_ZSTD_LONG = 2 };
+void _zstd_set_stage(int stage, int level);
+int _zstd_encode_adaptive(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+int _zstd_decode_adaptive(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
 int _zstd_decode(
     unsigned char *input, size_t input_sz,	  //
     unsigned char **output, size_t *output_sz,	  //
     void *(*realloc_func)(void *, size_t, size_t) //
 );
+int _zstd_encode_dict(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
 int _zstd_encode(
     unsigned char *input, size_t input_sz,	  //
     unsigned char **output, size_t *output_sz,	  //
     void *(*realloc_func)(void *, size_t, size_t) //
 );
+
+// zstd dictionaries trained from the encoded values. they are digested once per
+// process, the loader is called when a dictionary is not loaded yet.
+int _zstd_dictionary_train(
+    unsigned char **inputs, size_t *input_sizes, size_t n, //
+    size_t dict_cap,					   //
+    unsigned char **output, size_t *output_sz,		   //
+    void *(*realloc_func)(void *, size_t, size_t)	   //
+);
+uint32_t _zstd_dictionary_id(unsigned char *dict, size_t dict_sz);
+int _zstd_dictionary_load(unsigned char *dict, size_t dict_sz);
+bool _zstd_dictionary_exists(uint32_t id);
+void _zstd_dictionary_set_loader(int (*loader)(uint32_t id));
@@ -2,12 +2,98 @@
 
 create schema if not exists ts;
 
+-- the decoders are immutable, a dictionary is found by its id which zstd derives from its content. the encoders are
+-- stable, the output depends on pgts.compression, pgts.zstd_level, pgts.codec and ts.dictionary
+
 -- bigint or timestamp
-create or replace function ts.u8_encode(v bigint[]) returns bytea strict as 'MODULE_PATHNAME' language c;
-create or replace function ts.u8_decode(v bytea) returns bigint[] strict as 'MODULE_PATHNAME' language c;
-create or replace function ts.timestamp_encode(v timestamp[]) returns bytea strict as 'MODULE_PATHNAME' language c;
-create or replace function ts.timestamp_decode(v bytea) returns timestamp[] strict as 'MODULE_PATHNAME' language c;
+create or replace function ts.u8_encode(v bigint[]) returns bytea stable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.u8_decode(v bytea) returns bigint[] immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.timestamp_encode(v timestamp[]) returns bytea stable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.timestamp_decode(v bytea) returns timestamp[] immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+
+-- zstd dictionaries for short values. the id of the dictionary is recorded in the zstd frame header
+create table ts.dictionary (id bigint primary key, dictionary bytea not null);
+select pg_catalog.pg_extension_config_dump('ts.dictionary', '');
+create or replace function ts.train_dictionary(sample bytea[], size integer default 16384) returns bigint strict as 'MODULE_PATHNAME' language c;
+create or replace function ts.u8_encode(v bigint[], dictionary bigint) returns bytea stable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.timestamp_encode(v timestamp[], dictionary bigint) returns bytea stable strict parallel safe as 'MODULE_PATHNAME' language c;
+
+-- append to an encoded value, only the last block is encoded again
+create or replace function ts.u8_append(series bytea, vals bigint[]) returns bytea stable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.timestamp_append(series bytea, vals timestamp[]) returns bytea stable strict parallel safe as 'MODULE_PATHNAME', 'u8_append' language c;
+
+-- random access, only the blocks in the range are decoded. start and idx are 1 based
+create or replace function ts.u8_slice(v bytea, start integer, count integer) returns bigint[] immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.u8_at(v bytea, idx integer) returns bigint immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+
+-- aggregates of an encoded value, computed while decoding without building an array
+create or replace function ts.u8_count(v bytea) returns bigint immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.u8_sum(v bytea) returns numeric immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.u8_avg(v bytea) returns numeric immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.u8_min(v bytea) returns bigint immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.u8_max(v bytea) returns bigint immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+
+-- decode one value per row, stop decoding when no more rows are needed
+create or replace function ts.u8_unnest(v bytea) returns setof bigint immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.timestamp_unnest(v bytea) returns setof timestamp immutable strict parallel safe as 'MODULE_PATHNAME', 'u8_unnest' language c;
+
+-- the rows of a window, ctime is sorted. only the range [lo, hi] of ctime and val is decoded
+create or replace function ts.decode_between(ctime bytea, val bytea, lo timestamp, hi timestamp) returns table(ts timestamp, value bigint) immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+
+-- the rollup of val over the buckets of the sorted ctime, ctime and val are decoded in lockstep without forming the rows.
+-- agg is one of count, sum, avg, min, max, first or last. the nulls of val are skipped
+create or replace function ts.time_bucket_agg(ctime bytea, val bytea, bucket interval, agg text) returns table(ts timestamp, value numeric) immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.time_bucket_stats(ctime bytea, val bytea, bucket interval) returns table(ts timestamp, count bigint, min bigint, max bigint, avg numeric) immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+
+-- the rows of ctime and the columns decoded in lockstep batches, the types are given by the column definition list:
+-- bigint, timestamp or double precision, which reads the output of ts.f8_encode
+create or replace function ts.decode_rows(ctime bytea, variadic cols bytea[]) returns setof record immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+
+-- streaming aggregate of bigint or timestamp, encode the values as rows arrive
+create or replace function ts.u8_agg_transfn(internal, bigint) returns internal parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.timestamp_agg_transfn(internal, timestamp) returns internal parallel safe as 'MODULE_PATHNAME', 'u8_agg_transfn' language c;
+create or replace function ts.u8_agg_finalfn(internal) returns bytea parallel safe as 'MODULE_PATHNAME' language c;
+-- the partial aggregates of parallel workers, the leader appends the encoded chunks of the workers
+create or replace function ts.u8_agg_combinefn(internal, internal) returns internal parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.u8_agg_serialfn(internal) returns bytea strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.u8_agg_deserialfn(bytea, internal) returns internal strict parallel safe as 'MODULE_PATHNAME' language c;
+create aggregate ts.u8_agg(bigint) (
+  sfunc = ts.u8_agg_transfn, stype = internal, finalfunc = ts.u8_agg_finalfn,
+  combinefunc = ts.u8_agg_combinefn, serialfunc = ts.u8_agg_serialfn, deserialfunc = ts.u8_agg_deserialfn, parallel = safe
+);
+create aggregate ts.timestamp_agg(timestamp) (
+  sfunc = ts.timestamp_agg_transfn, stype = internal, finalfunc = ts.u8_agg_finalfn,
+  combinefunc = ts.u8_agg_combinefn, serialfunc = ts.u8_agg_serialfn, deserialfunc = ts.u8_agg_deserialfn, parallel = safe
+);
 
 -- double precision
-create or replace function ts.f8_encode(v double precision[]) returns bytea strict as 'MODULE_PATHNAME' language c;
-create or replace function ts.f8_decode(v bytea) returns table (v double precision) strict as 'MODULE_PATHNAME' language c;
+create or replace function ts.f8_encode(v double precision[]) returns bytea stable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.f8_encode(v double precision[], dictionary bigint) returns bytea stable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.f8_decode(v bytea) returns double precision[] immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+
+-- the columns of an archived row in one value, column 0 is ctime and the columns follow in order. a single column is
+-- read from the directory at the beginning without fetching the other columns
+create or replace function ts.rowgroup_encode(ctime timestamp[], variadic cols "any") returns bytea stable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.rowgroup_column(rg bytea, col integer) returns bytea immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.rowgroup_u8_decode(rg bytea, col integer) returns bigint[] immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.rowgroup_timestamp_decode(rg bytea, col integer) returns timestamp[] immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.rowgroup_f8_decode(rg bytea, col integer) returns double precision[] immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+
+-- the encoded series of bigint or timestamp, stored external as the blocks are compressed already. the text form is
+-- the array of the values. the metadata is read from the prefix of the value without reading the whole value
+create type ts.series;
+create or replace function ts.series_in(cstring) returns ts.series immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.series_out(ts.series) returns cstring immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.series_recv(internal) returns ts.series immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create or replace function ts.series_send(ts.series) returns bytea immutable strict parallel safe as 'MODULE_PATHNAME' language c;
+create type ts.series (
+  input = ts.series_in, output = ts.series_out, receive = ts.series_recv, send = ts.series_send,
+  internallength = variable, storage = external
+);
+create or replace function ts.series(bytea) returns ts.series immutable strict parallel safe as 'MODULE_PATHNAME', 'series_from_bytea' language c;
+create cast (bytea as ts.series) with function ts.series(bytea) as assignment;
+create cast (ts.series as bytea) without function as implicit;
+create or replace function ts.count(s ts.series) returns bigint immutable strict parallel safe as 'MODULE_PATHNAME', 'series_count' language c;
+create or replace function ts.first(s ts.series) returns bigint immutable strict parallel safe as 'MODULE_PATHNAME', 'series_first' language c;
+create or replace function ts.last(s ts.series) returns bigint immutable strict parallel safe as 'MODULE_PATHNAME', 'series_last' language c;
+create or replace function ts.time_range(s ts.series) returns tsrange immutable strict parallel safe as 'MODULE_PATHNAME', 'series_time_range' language c;
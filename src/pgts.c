@@ -1,11 +1,20 @@
 #include "c.h"
 #include "postgres.h"
 
+#include "access/htup_details.h" // for heap_form_tuple
 #include "catalog/pg_type_d.h"
 #include "datatype/timestamp.h" // for timestamp type
+#include "executor/spi.h"	// for the dictionary table
 #include "fmgr.h"		// for PG_FUNCTION_*
+#include "funcapi.h"		// for SRF_*
+#include "libpq/pqformat.h"	// for pq_getmsgbytes
 #include "utils/array.h"
-#include "utils/timestamp.h" // for timestamptz_to_time_t
+#include "utils/builtins.h"  // for format_type_be
+#include "utils/guc.h"	     // for pgts.compression
+#include "utils/lsyscache.h" // for get_typlenbyvalalign
+#include "utils/numeric.h"
+#include "utils/rangetypes.h" // for ts.time_range
+#include "utils/timestamp.h"  // for timestamptz_to_time_t
 
 #define ARRNELEMS(x) ArrayGetNItems(ARR_NDIM(x), ARR_DIMS(x))
 #define ARRPTR(x) ((uint64_t *)ARR_DATA_PTR(x))
@@ -22,6 +31,248 @@ static void *_realloc(void *p, size_t o, size_t n)
 	return repalloc(p, n);
 }
 
+// load the dictionary from ts.dictionary when it is used the first time in this backend
+static int load_dictionary(uint32_t id)
+{
+	int ret = -1;
+	Oid argtypes[1] = {INT8OID};
+	Datum args[1] = {Int64GetDatum(id)};
+
+	SPI_connect();
+	if (SPI_execute_with_args("select dictionary from ts.dictionary where id = $1", 1, argtypes, args, NULL, true, 1) ==
+		SPI_OK_SELECT &&
+	    SPI_processed == 1) {
+		bool isnull = true;
+		Datum d = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull);
+		if (!isnull) {
+			bytea *dict = DatumGetByteaPP(d);
+			ret = _zstd_dictionary_load((uint8_t *)VARDATA_ANY(dict), VARSIZE_ANY_EXHDR(dict));
+		}
+	}
+	SPI_finish();
+
+	return ret;
+}
+
+// the second stage compression of the bitstream
+static int compression = TE_STAGE_ZSTD;
+static int zstd_level = 0;
+
+static const struct config_enum_entry compression_options[] = {
+    {"none", TE_STAGE_NONE, false},
+    {"zstd", TE_STAGE_ZSTD, false},
+    {"zstd_long", TE_STAGE_ZSTD_LONG, false},
+    {NULL, 0, false},
+};
+
+static void assign_compression(int newval, void *extra) { _zstd_set_stage(newval, zstd_level); }
+
+// the codec of the blocks of bigint and timestamp
+static int codec = TE_CODEC_AUTO;
+
+static const struct config_enum_entry codec_options[] = {
+    {"auto", TE_CODEC_AUTO, false},
+    {"pfor", TE_CODEC_PFOR, false},
+    {NULL, 0, false},
+};
+
+static void assign_codec(int newval, void *extra) { _u8_set_codec(newval); }
+
+static void assign_zstd_level(int newval, void *extra) { _zstd_set_stage(compression, newval); }
+
+void _PG_init(void)
+{
+	_zstd_dictionary_set_loader(load_dictionary);
+
+	DefineCustomEnumVariable(
+	    "pgts.compression",
+	    "The compression after encoding: none, zstd, or zstd_long for huge values.",
+	    "zstd is only kept when it saves space, the raw bitstream is stored otherwise.",
+	    &compression,
+	    TE_STAGE_ZSTD,
+	    compression_options,
+	    PGC_USERSET,
+	    0,
+	    NULL,
+	    assign_compression,
+	    NULL);
+
+	DefineCustomIntVariable(
+	    "pgts.zstd_level",
+	    "The zstd compression level, 0 is the default level of zstd.",
+	    NULL,
+	    &zstd_level,
+	    0,
+	    -7,
+	    22,
+	    PGC_USERSET,
+	    0,
+	    NULL,
+	    assign_zstd_level,
+	    NULL);
+
+	DefineCustomEnumVariable(
+	    "pgts.codec",
+	    "The codec of the blocks of bigint and timestamp: auto or pfor.",
+	    "auto picks the smallest codec of each block, pfor packs the deltas in frames which decode faster.",
+	    &codec,
+	    TE_CODEC_AUTO,
+	    codec_options,
+	    PGC_USERSET,
+	    0,
+	    NULL,
+	    assign_codec,
+	    NULL);
+
+	MarkGUCPrefixReserved("pgts");
+}
+
+// the optional dictionary argument of the encode functions, 0 for no dictionary
+static uint32_t dictionary_arg(FunctionCallInfo fcinfo, int n)
+{
+	if (PG_NARGS() <= n)
+		return 0;
+
+	int64 id = PG_GETARG_INT64(n);
+	if (id <= 0 || id > PG_UINT32_MAX || !_zstd_dictionary_exists(id))
+		ereport(ERROR, (errcode(ERRCODE_UNDEFINED_OBJECT), errmsg("dictionary " INT64_FORMAT " does not exist", id)));
+
+	return id;
+}
+
+static bytea *bytea_from(uint8_t *data, size_t n)
+{
+	bytea *ret = palloc(VARHDRSZ + n);
+	SET_VARSIZE(ret, VARHDRSZ + n);
+	memcpy(VARDATA(ret), data, n);
+	return ret;
+}
+
+// the output of the encoders is allocated with the header of the varlena in
+// front of it, so the output becomes the bytea without another copy. only used
+// for the output buffer, which is never freed by pfree.
+static void *_realloc_varlena(void *p, size_t o, size_t n)
+{
+	if (p == NULL)
+		return (char *)palloc(VARHDRSZ + n) + VARHDRSZ;
+
+	return (char *)repalloc((char *)p - VARHDRSZ, VARHDRSZ + n) + VARHDRSZ;
+}
+
+static bytea *bytea_of_output(uint8_t *data, size_t n)
+{
+	bytea *ret = (bytea *)(data - VARHDRSZ);
+	SET_VARSIZE(ret, VARHDRSZ + n);
+	return ret;
+}
+
+// one dimension array of int8, float8 or timestamp, the data is not set
+static ArrayType *array_alloc_8bytes(size_t n, Oid elemtype)
+{
+	if (n == 0)
+		return construct_empty_array(elemtype);
+
+	int32_t nbytes = ARR_OVERHEAD_NONULLS(1) + n * 8;
+
+	ArrayType *ret = (ArrayType *)palloc0(nbytes);
+
+	SET_VARSIZE(ret, nbytes);
+	ARR_NDIM(ret) = 1;
+	ret->dataoffset = 0;
+	ARR_ELEMTYPE(ret) = elemtype;
+	ARR_DIMS(ret)[0] = n;
+	ARR_LBOUND(ret)[0] = 1;
+	return ret;
+}
+
+// one dimension array with a null bitmap, the bitmap is clear and the data of
+// the nvalid values is not set. without nulls the array has no bitmap.
+static ArrayType *array_alloc_nulls(size_t n, size_t nvalid, Oid elemtype)
+{
+	if (nvalid == n)
+		return array_alloc_8bytes(n, elemtype);
+
+	int32_t dataoffset = ARR_OVERHEAD_WITHNULLS(1, n);
+	int32_t nbytes = dataoffset + nvalid * 8;
+
+	ArrayType *ret = (ArrayType *)palloc0(nbytes);
+
+	SET_VARSIZE(ret, nbytes);
+	ARR_NDIM(ret) = 1;
+	ret->dataoffset = dataoffset;
+	ARR_ELEMTYPE(ret) = elemtype;
+	ARR_DIMS(ret)[0] = n;
+	ARR_LBOUND(ret)[0] = 1;
+	return ret;
+}
+
+static ArrayType *array_from_8bytes(void *values, size_t n, Oid elemtype)
+{
+	ArrayType *ret = array_alloc_8bytes(n, elemtype);
+	if (n > 0)
+		memcpy(ARR_DATA_PTR(ret), values, n * 8);
+
+	return ret;
+}
+
+// decode the slice of the series to the data of the output array directly. the
+// values of a series with nulls are read with the nulls, then packed before
+// the data as postgres keeps them.
+static ArrayType *array_from_u8_slice(bytea *inb, size_t start, size_t count, Oid elemtype)
+{
+	uint8_t *in = (uint8_t *)VARDATA_ANY(inb);
+	size_t inn = VARSIZE_ANY_EXHDR(inb);
+
+	U8Decoder *d = _u8_decoder_create(in, inn, _realloc);
+	if (d == NULL)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+	size_t n = _u8_decoder_count(d), outn = 0;
+	start = Min(start, n);
+	count = Min(count, n - start);
+	if (start > 0 && _u8_decoder_seek(d, start) != 0)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+	ArrayType *ret = NULL;
+	if (!_nulls_exist(in, inn)) {
+		ret = array_alloc_8bytes(count, elemtype);
+		uint64_t *data = (uint64_t *)ARR_DATA_PTR(ret);
+		if (count > 0 && (_u8_decoder_read(d, data, count, &outn) != 0 || outn != count))
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+		_u8_decoder_free(d, pfree);
+		return ret;
+	}
+
+	uint64_t *values = palloc(Max(count, 1) * 8);
+	bool *nulls = palloc(Max(count, 1));
+	if (count > 0 && (_u8_decoder_read_nulls(d, values, nulls, count, &outn) != 0 || outn != count))
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+	size_t nvalid = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (!nulls[i])
+			values[nvalid++] = values[i];
+	}
+
+	ret = array_alloc_nulls(count, nvalid, elemtype);
+	bits8 *bitmap = ARR_NULLBITMAP(ret);
+	for (size_t i = 0; bitmap != NULL && i < count; ++i)
+		bitmap[i / 8] |= !nulls[i] << (i % 8);
+
+	if (nvalid > 0)
+		memcpy(ARR_DATA_PTR(ret), values, nvalid * 8);
+
+	_u8_decoder_free(d, pfree);
+	pfree(values), pfree(nulls);
+	return ret;
+}
+
+static ArrayType *array_from_u8_series(bytea *inb, Oid elemtype)
+{
+	return array_from_u8_slice(inb, 0, SIZE_MAX, elemtype);
+}
+
 PG_FUNCTION_INFO_V1(u8_encode);
 Datum u8_encode(PG_FUNCTION_ARGS)
 {
@@ -31,58 +282,562 @@ Datum u8_encode(PG_FUNCTION_ARGS)
 	uint8_t *out = NULL;
 	size_t outn = 0;
 
-	_u8_encode(ARRPTR(in), inn, &out, &outn, _realloc);
+	if (_u8_series_encode_nulls(ARRPTR(in), ARR_NULLBITMAP(in), inn, dictionary_arg(fcinfo, 1), &out, &outn,
+				    _realloc_varlena) != 0)
+		ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED), errmsg("too many values to encode")));
 
-	{
-		uint8_t *a = NULL;
-		size_t an = 0;
-		_zstd_encode(out, outn, &a, &an, _realloc);
-		outn = an;
-		out = a;
-	}
+	PG_RETURN_BYTEA_P(bytea_of_output(out, outn));
+}
+
+PG_FUNCTION_INFO_V1(u8_decode);
+Datum u8_decode(PG_FUNCTION_ARGS) { PG_RETURN_ARRAYTYPE_P(array_from_u8_series(PG_GETARG_BYTEA_P(0), INT8OID)); }
+
+// start is 1 based as the array subscript, only the blocks in the range are decoded
+PG_FUNCTION_INFO_V1(u8_slice);
+Datum u8_slice(PG_FUNCTION_ARGS)
+{
+	bytea *inb = PG_GETARG_BYTEA_P(0);
+	int32_t start = PG_GETARG_INT32(1);
+	int32_t count = PG_GETARG_INT32(2);
 
-	bytea *ret = palloc(VARHDRSZ + outn);
-	SET_VARSIZE(ret, VARHDRSZ + outn);
-	memcpy(VARDATA_EXTERNAL(ret), out, outn);
+	if (start < 1 || count < 0)
+		ereport(ERROR, (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR), errmsg("invalid slice [%d, +%d]", start, count)));
 
-	PG_RETURN_BYTEA_P(ret);
+	PG_RETURN_ARRAYTYPE_P(array_from_u8_slice(inb, start - 1, count, INT8OID));
 }
 
-PG_FUNCTION_INFO_V1(u8_decode);
-Datum u8_decode(PG_FUNCTION_ARGS)
+// idx is 1 based, NULL if out of range
+PG_FUNCTION_INFO_V1(u8_at);
+Datum u8_at(PG_FUNCTION_ARGS)
 {
 	bytea *inb = PG_GETARG_BYTEA_P(0);
-	size_t inn = VARSIZE_ANY_EXHDR(inb);
+	int32_t idx = PG_GETARG_INT32(1);
 
-	uint8_t *in = (uint8_t *)VARDATA_ANY(inb);
-	uint64_t *out = NULL;
+	if (idx < 1)
+		PG_RETURN_NULL();
+
+	U8Decoder *d = _u8_decoder_create((uint8_t *)VARDATA_ANY(inb), VARSIZE_ANY_EXHDR(inb), _realloc);
+	if (d == NULL)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+	uint64_t out = 0;
+	bool null = false;
 	size_t outn = 0;
+	if (_u8_decoder_seek(d, idx - 1) != 0 || _u8_decoder_read_nulls(d, &out, &null, 1, &outn) != 0)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+	_u8_decoder_free(d, pfree);
+	if (outn == 0 || null)
+		PG_RETURN_NULL();
+
+	PG_RETURN_INT64(out);
+}
+
+// the sum of at most 2^24 int64 is in (-2^88, 2^88), it is split to two int64
+static Numeric numeric_from_int128(__int128 v)
+{
+	if (v >= PG_INT64_MIN && v <= PG_INT64_MAX)
+		return int64_to_numeric((int64)v);
+
+	// v = hi * 2^32 + lo
+	Numeric hi = int64_to_numeric((int64)(v >> 32));
+	Numeric lo = int64_to_numeric((int64)(v & 0xFFFFFFFF));
+	Numeric base = int64_to_numeric((int64)1 << 32);
+	return numeric_add_opt_error(numeric_mul_opt_error(hi, base, NULL), lo, NULL);
+}
 
-	{
-		uint8_t *a = NULL;
-		size_t an = 0;
-		_zstd_decode(in, inn, &a, &an, _realloc);
-		inn = an;
-		in = a;
+// the aggregates below are computed in the decode loop without building an array
+
+PG_FUNCTION_INFO_V1(u8_count);
+Datum u8_count(PG_FUNCTION_ARGS)
+{
+	bytea *inb = PG_GETARG_BYTEA_P(0);
+
+	uint32_t count = 0;
+	if (_u8_series_count((uint8_t *)VARDATA_ANY(inb), VARSIZE_ANY_EXHDR(inb), &count, _realloc) != 0)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+	PG_RETURN_INT64(count);
+}
+
+// sum and avg are numeric as the sum(bigint) and avg(bigint), NULL if empty
+PG_FUNCTION_INFO_V1(u8_sum);
+Datum u8_sum(PG_FUNCTION_ARGS)
+{
+	bytea *inb = PG_GETARG_BYTEA_P(0);
+
+	uint32_t count = 0;
+	__int128 sum = 0;
+	if (_u8_series_sum((uint8_t *)VARDATA_ANY(inb), VARSIZE_ANY_EXHDR(inb), &count, &sum, _realloc) != 0)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+	if (count == 0)
+		PG_RETURN_NULL();
+
+	PG_RETURN_NUMERIC(numeric_from_int128(sum));
+}
+
+PG_FUNCTION_INFO_V1(u8_avg);
+Datum u8_avg(PG_FUNCTION_ARGS)
+{
+	bytea *inb = PG_GETARG_BYTEA_P(0);
+
+	uint32_t count = 0;
+	__int128 sum = 0;
+	if (_u8_series_sum((uint8_t *)VARDATA_ANY(inb), VARSIZE_ANY_EXHDR(inb), &count, &sum, _realloc) != 0)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+	if (count == 0)
+		PG_RETURN_NULL();
+
+	PG_RETURN_NUMERIC(numeric_div_opt_error(numeric_from_int128(sum), int64_to_numeric(count), NULL));
+}
+
+// min and max share the decode loop, NULL if empty
+static bool u8_min_max(bytea *inb, int64_t *min, int64_t *max)
+{
+	uint32_t count = 0;
+	if (_u8_series_min_max((uint8_t *)VARDATA_ANY(inb), VARSIZE_ANY_EXHDR(inb), &count, min, max, _realloc) != 0)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+	return count > 0;
+}
+
+PG_FUNCTION_INFO_V1(u8_min);
+Datum u8_min(PG_FUNCTION_ARGS)
+{
+	int64_t min = 0, max = 0;
+	if (!u8_min_max(PG_GETARG_BYTEA_P(0), &min, &max))
+		PG_RETURN_NULL();
+
+	PG_RETURN_INT64(min);
+}
+
+PG_FUNCTION_INFO_V1(u8_max);
+Datum u8_max(PG_FUNCTION_ARGS)
+{
+	int64_t min = 0, max = 0;
+	if (!u8_min_max(PG_GETARG_BYTEA_P(0), &min, &max))
+		PG_RETURN_NULL();
+
+	PG_RETURN_INT64(max);
+}
+
+// u8_unnest/timestamp_unnest keep the decoder across calls and decode a small
+// batch at a time, decoding stops when the executor stops asking for rows.
+typedef struct U8UnnestState {
+	U8Decoder *decoder;
+	size_t n, i;
+	uint64_t values[128];
+	bool nulls[128];
+} U8UnnestState;
+
+PG_FUNCTION_INFO_V1(u8_unnest);
+Datum u8_unnest(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	U8UnnestState *state;
+
+	if (SRF_IS_FIRSTCALL()) {
+		funcctx = SRF_FIRSTCALL_INIT();
+		MemoryContext old = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		bytea *inb = PG_GETARG_BYTEA_P(0);
+		size_t inn = VARSIZE_ANY_EXHDR(inb);
+		uint8_t *in = (uint8_t *)VARDATA_ANY(inb);
+
+		state = palloc0(sizeof(U8UnnestState));
+		state->decoder = _u8_decoder_create(in, inn, _realloc);
+		if (state->decoder == NULL)
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+		funcctx->user_fctx = state;
+		MemoryContextSwitchTo(old);
 	}
 
-	_u8_decode(in, inn, &out, &outn, _realloc);
+	funcctx = SRF_PERCALL_SETUP();
+	state = funcctx->user_fctx;
 
-	int32_t nbytes = ARR_OVERHEAD_NONULLS(1) + outn;
+	// the decoder reads blocks in the multi call context, the scratch it
+	// allocates lives across calls
+	if (state->i == state->n) {
+		MemoryContext old = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		if (_u8_decoder_read_nulls(state->decoder, state->values, state->nulls, lengthof(state->values),
+					   &state->n) != 0)
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+		MemoryContextSwitchTo(old);
 
-	ArrayType *ret = (ArrayType *)palloc0(nbytes);
+		state->i = 0;
+	}
 
-	SET_VARSIZE(ret, nbytes);
-	ARR_NDIM(ret) = 1;
-	ret->dataoffset = 0;
-	ARR_ELEMTYPE(ret) = INT8OID;
-	ARR_DIMS(ret)[0] = outn / sizeof(int64_t);
+	if (state->n == 0)
+		SRF_RETURN_DONE(funcctx);
+
+	if (state->nulls[state->i++])
+		SRF_RETURN_NEXT_NULL(funcctx);
+
+	SRF_RETURN_NEXT(funcctx, Int64GetDatum(state->values[state->i - 1]));
+}
+
+// decode_between finds the range of ctime in [lo, hi] from the block index,
+// then decodes the range of ctime and val in batches, the rows outside the
+// range are never decoded.
+typedef struct DecodeBetweenState {
+	U8Decoder *ctime, *val;
+	size_t remaining; // the rows left in the range
+	size_t n, i;
+	uint64_t ctimes[128], vals[128];
+	bool val_nulls[128];
+} DecodeBetweenState;
 
-	for (int i = 0; i < outn / sizeof(int64_t); i++) {
-		((int64_t *)ARRPTR(ret))[i] = Int64GetDatum(out[i]);
+PG_FUNCTION_INFO_V1(decode_between);
+Datum decode_between(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	DecodeBetweenState *state;
+
+	if (SRF_IS_FIRSTCALL()) {
+		funcctx = SRF_FIRSTCALL_INIT();
+		MemoryContext old = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		bytea *ctimeb = PG_GETARG_BYTEA_P(0);
+		bytea *valb = PG_GETARG_BYTEA_P(1);
+		Timestamp lo = PG_GETARG_TIMESTAMP(2);
+		Timestamp hi = PG_GETARG_TIMESTAMP(3);
+
+		TupleDesc tupdesc;
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("return type must be a row type")));
+
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		// the search needs every ctime, a null of val is a null value of the row
+		if (_nulls_exist((uint8_t *)VARDATA_ANY(ctimeb), VARSIZE_ANY_EXHDR(ctimeb)))
+			ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("ctime can not have null values")));
+
+		size_t start = 0;
+		state = palloc0(sizeof(DecodeBetweenState));
+		state->ctime = _u8_decoder_create((uint8_t *)VARDATA_ANY(ctimeb), VARSIZE_ANY_EXHDR(ctimeb), _realloc);
+		state->val = _u8_decoder_create((uint8_t *)VARDATA_ANY(valb), VARSIZE_ANY_EXHDR(valb), _realloc);
+		if (state->ctime == NULL || state->val == NULL ||
+		    _u8_series_search((uint8_t *)VARDATA_ANY(ctimeb), VARSIZE_ANY_EXHDR(ctimeb), lo, hi, &start,
+				      &state->remaining, _realloc) != 0)
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+		if (_u8_decoder_count(state->ctime) != _u8_decoder_count(state->val))
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("ctime has %u values but val has %u", _u8_decoder_count(state->ctime),
+					       _u8_decoder_count(state->val))));
+
+		if (_u8_decoder_seek(state->ctime, start) != 0 || _u8_decoder_seek(state->val, start) != 0)
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+		funcctx->user_fctx = state;
+		MemoryContextSwitchTo(old);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = funcctx->user_fctx;
+
+	if (state->remaining == 0)
+		SRF_RETURN_DONE(funcctx);
+
+	// the decoders read blocks in the multi call context, the scratch they
+	// allocate lives across calls
+	if (state->i == state->n) {
+		size_t n = Min(state->remaining, lengthof(state->ctimes)), ctime_n = 0, val_n = 0;
+		MemoryContext old = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		if (_u8_decoder_read(state->ctime, state->ctimes, n, &ctime_n) != 0 ||
+		    _u8_decoder_read_nulls(state->val, state->vals, state->val_nulls, n, &val_n) != 0 || ctime_n != n ||
+		    val_n != n)
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+		MemoryContextSwitchTo(old);
+
+		state->n = n, state->i = 0;
+	}
+
+	Datum values[2] = {TimestampGetDatum(state->ctimes[state->i]), Int64GetDatum(state->vals[state->i])};
+	bool nulls[2] = {false, state->val_nulls[state->i]};
+	state->i++, state->remaining--;
+
+	HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+}
+
+// time_bucket_agg and time_bucket_stats walk the decoders of ctime and val in
+// lockstep and return a row per bucket, the rows of the series are never
+// formed. the buckets start at multiples of the interval from 2000-01-01.
+enum { BUCKET_COUNT, BUCKET_SUM, BUCKET_AVG, BUCKET_MIN, BUCKET_MAX, BUCKET_FIRST, BUCKET_LAST };
+static const char *bucket_aggs[] = {"count", "sum", "avg", "min", "max", "first", "last"};
+
+typedef struct TimeBucketState {
+	U8Bucketer *bucketer;
+	int agg;
+} TimeBucketState;
+
+// the decoders read blocks in the multi call context, the scratch they allocate
+// lives across calls
+static TimeBucketState *time_bucket_state(FunctionCallInfo fcinfo, FuncCallContext *funcctx)
+{
+	bytea *ctimeb = PG_GETARG_BYTEA_P(0);
+	bytea *valb = PG_GETARG_BYTEA_P(1);
+	Interval *bucket = PG_GETARG_INTERVAL_P(2);
+
+	if (bucket->month != 0)
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("bucket can not have months or years")));
+
+	int64_t width = bucket->time + (int64_t)bucket->day * USECS_PER_DAY;
+	if (width <= 0)
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("bucket must be positive")));
+
+	if (_nulls_exist((uint8_t *)VARDATA_ANY(ctimeb), VARSIZE_ANY_EXHDR(ctimeb)))
+		ereport(ERROR, (errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("ctime can not have null values")));
+
+	TupleDesc tupdesc;
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("return type must be a row type")));
+
+	funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+	TimeBucketState *state = palloc0(sizeof(TimeBucketState));
+	state->bucketer = _u8_bucketer_create((uint8_t *)VARDATA_ANY(ctimeb), VARSIZE_ANY_EXHDR(ctimeb),
+					      (uint8_t *)VARDATA_ANY(valb), VARSIZE_ANY_EXHDR(valb), width, _realloc,
+					      pfree);
+	if (state->bucketer == NULL)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+				errmsg("invalid u8 encoded data, or ctime and val have different counts")));
+
+	return state;
+}
+
+static bool time_bucket_next(FuncCallContext *funcctx, TimeBucketState *state, TimeBucket *bucket)
+{
+	MemoryContext old = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+	int ret = _u8_bucketer_next(state->bucketer, bucket);
+	MemoryContextSwitchTo(old);
+
+	if (ret < 0)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+	return ret == 1;
+}
+
+PG_FUNCTION_INFO_V1(time_bucket_agg);
+Datum time_bucket_agg(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	TimeBucketState *state;
+
+	if (SRF_IS_FIRSTCALL()) {
+		funcctx = SRF_FIRSTCALL_INIT();
+		MemoryContext old = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		char *agg = text_to_cstring(PG_GETARG_TEXT_PP(3));
+		int i = 0;
+		while (i < lengthof(bucket_aggs) && pg_strcasecmp(agg, bucket_aggs[i]) != 0)
+			i++;
+
+		if (i == lengthof(bucket_aggs))
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("unknown aggregate \"%s\"", agg),
+					errhint("agg is count, sum, avg, min, max, first or last")));
+
+		state = time_bucket_state(fcinfo, funcctx);
+		state->agg = i;
+		funcctx->user_fctx = state;
+		MemoryContextSwitchTo(old);
 	}
 
-	PG_RETURN_ARRAYTYPE_P(ret);
+	funcctx = SRF_PERCALL_SETUP();
+	state = funcctx->user_fctx;
+
+	TimeBucket b;
+	if (!time_bucket_next(funcctx, state, &b))
+		SRF_RETURN_DONE(funcctx);
+
+	Datum values[2] = {TimestampGetDatum(b.start), (Datum)0};
+	bool nulls[2] = {false, false};
+	int64_t ints[] = {[BUCKET_MIN] = b.min, [BUCKET_MAX] = b.max, [BUCKET_FIRST] = b.first, [BUCKET_LAST] = b.last};
+	if (state->agg == BUCKET_COUNT)
+		values[1] = NumericGetDatum(int64_to_numeric(b.count));
+	else if (b.count == 0)
+		nulls[1] = true; // a bucket of nulls
+	else if (state->agg == BUCKET_SUM)
+		values[1] = NumericGetDatum(numeric_from_int128(b.sum));
+	else if (state->agg == BUCKET_AVG)
+		values[1] =
+		    NumericGetDatum(numeric_div_opt_error(numeric_from_int128(b.sum), int64_to_numeric(b.count), NULL));
+	else
+		values[1] = NumericGetDatum(int64_to_numeric(ints[state->agg]));
+
+	HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+}
+
+// count, min, max and avg of every bucket in one pass
+PG_FUNCTION_INFO_V1(time_bucket_stats);
+Datum time_bucket_stats(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	TimeBucketState *state;
+
+	if (SRF_IS_FIRSTCALL()) {
+		funcctx = SRF_FIRSTCALL_INIT();
+		MemoryContext old = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		funcctx->user_fctx = time_bucket_state(fcinfo, funcctx);
+		MemoryContextSwitchTo(old);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = funcctx->user_fctx;
+
+	TimeBucket b;
+	if (!time_bucket_next(funcctx, state, &b))
+		SRF_RETURN_DONE(funcctx);
+
+	Datum values[5] = {TimestampGetDatum(b.start), Int64GetDatum(b.count), Int64GetDatum(b.min),
+			   Int64GetDatum(b.max), (Datum)0};
+	bool nulls[5] = {false, false, b.count == 0, b.count == 0, b.count == 0};
+	if (b.count > 0)
+		values[4] =
+		    NumericGetDatum(numeric_div_opt_error(numeric_from_int128(b.sum), int64_to_numeric(b.count), NULL));
+
+	HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+}
+
+// decode_rows opens a decoder per column and decodes the columns in lockstep
+// batches, the batch of every column stays in the cache while its rows are
+// formed. the type of a column is taken from the column definition list, the
+// double precision columns are read by the float8 decoder.
+#define DECODE_ROWS_BATCH 128
+
+typedef struct DecodeRowsState {
+	int ncolumns; // ctime and the columns
+	U8Decoder **decoders;
+	Oid *types;
+	size_t remaining; // the rows left
+	size_t n, i;
+	uint64_t *values; // DECODE_ROWS_BATCH values of each column
+	bool *nulls;
+	Datum *row;
+	bool *row_nulls;
+} DecodeRowsState;
+
+static DecodeRowsState *decode_rows_state(FunctionCallInfo fcinfo, FuncCallContext *funcctx)
+{
+	bytea *ctimeb = PG_GETARG_BYTEA_P(0);
+	ArrayType *cols = PG_GETARG_ARRAYTYPE_P(1);
+
+	TupleDesc tupdesc;
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("return type must be a row type")));
+
+	funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+	int16 typlen;
+	bool typbyval;
+	char typalign;
+	get_typlenbyvalalign(BYTEAOID, &typlen, &typbyval, &typalign);
+
+	Datum *elems;
+	bool *elem_nulls;
+	int n = 0;
+	deconstruct_array(cols, BYTEAOID, typlen, typbyval, typalign, &elems, &elem_nulls, &n);
+
+	if (tupdesc->natts != n + 1)
+		ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+				errmsg("%d columns are decoded but the row has %d", n + 1, tupdesc->natts)));
+
+	DecodeRowsState *state = palloc0(sizeof(DecodeRowsState));
+	state->ncolumns = n + 1;
+	state->decoders = palloc(state->ncolumns * sizeof(U8Decoder *));
+	state->types = palloc(state->ncolumns * sizeof(Oid));
+	state->values = palloc(state->ncolumns * DECODE_ROWS_BATCH * sizeof(uint64_t));
+	state->nulls = palloc(state->ncolumns * DECODE_ROWS_BATCH * sizeof(bool));
+	state->row = palloc(state->ncolumns * sizeof(Datum));
+	state->row_nulls = palloc(state->ncolumns * sizeof(bool));
+
+	for (int c = 0; c < state->ncolumns; ++c) {
+		char *name = NameStr(TupleDescAttr(tupdesc, c)->attname);
+		Oid type = TupleDescAttr(tupdesc, c)->atttypid;
+		if (type != INT8OID && type != TIMESTAMPOID && type != TIMESTAMPTZOID && type != FLOAT8OID)
+			ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+					errmsg("column \"%s\" can not be %s", name, format_type_be(type)),
+					errhint("the columns are bigint, timestamp or double precision")));
+
+		if (c > 0 && elem_nulls[c - 1])
+			ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED), errmsg("column \"%s\" is null", name)));
+
+		bytea *b = c == 0 ? ctimeb : DatumGetByteaPP(elems[c - 1]);
+		U8Decoder *(*create)(unsigned char *, size_t, void *(*)(void *, size_t, size_t)) =
+		    type == FLOAT8OID ? _f8_decoder_create : _u8_decoder_create;
+
+		state->types[c] = type;
+		state->decoders[c] = create((uint8_t *)VARDATA_ANY(b), VARSIZE_ANY_EXHDR(b), _realloc);
+		if (state->decoders[c] == NULL)
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED),
+					errmsg("invalid encoded data of column \"%s\"", name)));
+
+		uint32_t count = _u8_decoder_count(state->decoders[c]), rows = _u8_decoder_count(state->decoders[0]);
+		if (count != rows)
+			ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("column \"%s\" has %u values but ctime has %u", name, count, rows)));
+	}
+
+	state->remaining = _u8_decoder_count(state->decoders[0]);
+	return state;
+}
+
+PG_FUNCTION_INFO_V1(decode_rows);
+Datum decode_rows(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	DecodeRowsState *state;
+
+	if (SRF_IS_FIRSTCALL()) {
+		funcctx = SRF_FIRSTCALL_INIT();
+		MemoryContext old = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		funcctx->user_fctx = decode_rows_state(fcinfo, funcctx);
+		MemoryContextSwitchTo(old);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = funcctx->user_fctx;
+
+	if (state->remaining == 0)
+		SRF_RETURN_DONE(funcctx);
+
+	// the decoders read blocks in the multi call context, the scratch they
+	// allocate lives across calls
+	if (state->i == state->n) {
+		size_t n = Min(state->remaining, DECODE_ROWS_BATCH), read = 0;
+		MemoryContext old = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		for (int c = 0; c < state->ncolumns; ++c) {
+			if (_u8_decoder_read_nulls(state->decoders[c], state->values + c * DECODE_ROWS_BATCH,
+						   state->nulls + c * DECODE_ROWS_BATCH, n, &read) != 0 ||
+			    read != n)
+				ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid encoded data")));
+		}
+		MemoryContextSwitchTo(old);
+
+		state->n = n, state->i = 0;
+	}
+
+	for (int c = 0; c < state->ncolumns; ++c) {
+		uint64_t v = state->values[c * DECODE_ROWS_BATCH + state->i];
+		float64_t f;
+		memcpy(&f, &v, 8);
+
+		state->row[c] = state->types[c] == FLOAT8OID ? Float8GetDatum(f) : Int64GetDatum(v);
+		state->row_nulls[c] = state->nulls[c * DECODE_ROWS_BATCH + state->i];
+	}
+	state->i++, state->remaining--;
+
+	HeapTuple tuple = heap_form_tuple(funcctx->tuple_desc, state->row, state->row_nulls);
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
 }
 
 PG_FUNCTION_INFO_V1(timestamp_encode);
@@ -91,80 +846,525 @@ Datum timestamp_encode(PG_FUNCTION_ARGS)
 	ArrayType *in_ts = PG_GETARG_ARRAYTYPE_P(0);
 	int32_t inn = ARRNELEMS(in_ts);
 
-	uint64_t *in = palloc(inn * sizeof(int64_t));
-	for (int i = 0; i < inn; i++) {
-		in[i] = ARRPTR(in_ts)[i];
-	}
+	uint8_t *out = NULL;
+	size_t outn = 0;
+
+	if (_u8_series_encode_nulls(ARRPTR(in_ts), ARR_NULLBITMAP(in_ts), inn, dictionary_arg(fcinfo, 1), &out, &outn,
+				    _realloc_varlena) != 0)
+		ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED), errmsg("too many values to encode")));
+
+	PG_RETURN_BYTEA_P(bytea_of_output(out, outn));
+}
+
+PG_FUNCTION_INFO_V1(timestamp_decode);
+Datum timestamp_decode(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_ARRAYTYPE_P(array_from_u8_series(PG_GETARG_BYTEA_P(0), TIMESTAMPOID));
+}
+
+// ts.series is the encoded series of bigint or timestamp, the same bytes as the
+// encode functions return. it is stored external by default since the blocks
+// are compressed already, and the text form is the array of the values.
+static bytea *series_check(bytea *inb)
+{
+	uint32_t count = 0;
+	if (_u8_series_count((uint8_t *)VARDATA_ANY(inb), VARSIZE_ANY_EXHDR(inb), &count, _realloc) != 0)
+		ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION), errmsg("invalid series")));
+
+	return inb;
+}
+
+PG_FUNCTION_INFO_V1(series_in);
+Datum series_in(PG_FUNCTION_ARGS)
+{
+	Oid func = InvalidOid, ioparam = InvalidOid;
+	getTypeInputInfo(INT8ARRAYOID, &func, &ioparam);
+	ArrayType *in = DatumGetArrayTypeP(OidInputFunctionCall(func, PG_GETARG_CSTRING(0), ioparam, -1));
 
 	uint8_t *out = NULL;
 	size_t outn = 0;
+	if (_u8_series_encode_nulls(ARRPTR(in), ARR_NULLBITMAP(in), ARRNELEMS(in), 0, &out, &outn, _realloc_varlena) != 0)
+		ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED), errmsg("too many values to encode")));
+
+	PG_RETURN_BYTEA_P(bytea_of_output(out, outn));
+}
+
+PG_FUNCTION_INFO_V1(series_out);
+Datum series_out(PG_FUNCTION_ARGS)
+{
+	Oid func = InvalidOid;
+	bool isvarlena = false;
+	getTypeOutputInfo(INT8ARRAYOID, &func, &isvarlena);
+
+	ArrayType *values = array_from_u8_series(PG_GETARG_BYTEA_P(0), INT8OID);
+	PG_RETURN_CSTRING(OidOutputFunctionCall(func, PointerGetDatum(values)));
+}
+
+PG_FUNCTION_INFO_V1(series_recv);
+Datum series_recv(PG_FUNCTION_ARGS)
+{
+	StringInfo buf = (StringInfo)PG_GETARG_POINTER(0);
+	int n = buf->len - buf->cursor;
+	PG_RETURN_BYTEA_P(series_check(bytea_from((uint8_t *)pq_getmsgbytes(buf, n), n)));
+}
+
+PG_FUNCTION_INFO_V1(series_send);
+Datum series_send(PG_FUNCTION_ARGS) { PG_RETURN_BYTEA_P(PG_GETARG_BYTEA_P(0)); }
+
+// the cast from the bytea of the encode functions
+PG_FUNCTION_INFO_V1(series_from_bytea);
+Datum series_from_bytea(PG_FUNCTION_ARGS) { PG_RETURN_BYTEA_P(series_check(PG_GETARG_BYTEA_P(0))); }
+
+// the count, the first and the last value of a series. only the prefix, the
+// index and the last block are fetched, a series stored external is not read
+// as a whole. the format before the blocked series and a series with nulls are
+// decoded as a whole, nulls[0] and nulls[1] are set if first or last is null.
+static void series_bounds(Datum d, bool need_last, uint32_t *count, uint64_t *first, uint64_t *last, bool *nulls)
+{
+	nulls[0] = nulls[1] = false;
 
-	_u8_encode(in, inn, &out, &outn, _realloc);
+	bytea *prefix = DatumGetByteaPSlice(d, 0, SERIES_PREFIX_SZ);
+	int index_sz = _u8_series_prefix((uint8_t *)VARDATA_ANY(prefix), VARSIZE_ANY_EXHDR(prefix), count, first);
+	if (index_sz >= 0) {
+		if (!need_last || *count == 0)
+			return;
 
-	{
-		// TODO remove 4 bytes magic
-		uint8_t *a = NULL;
-		size_t an = 0;
-		_zstd_encode(out, outn, &a, &an, _realloc);
-		out = a;
-		outn = an;
+		size_t offset = 0;
+		bytea *index = DatumGetByteaPSlice(d, 0, index_sz);
+		if (_u8_series_tail((uint8_t *)VARDATA_ANY(index), VARSIZE_ANY_EXHDR(index), &offset) != 0)
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+		bytea *tail = DatumGetByteaPSlice(d, offset, -1);
+		if (_u8_series_last((uint8_t *)VARDATA_ANY(index), VARSIZE_ANY_EXHDR(index), (uint8_t *)VARDATA_ANY(tail),
+				    VARSIZE_ANY_EXHDR(tail), last, _realloc) != 0)
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+		return;
 	}
 
-	bytea *ret = palloc(VARHDRSZ + outn);
-	SET_VARSIZE(ret, VARHDRSZ + outn);
+	bytea *inb = DatumGetByteaP(d);
+	U8Decoder *decoder = _u8_decoder_create((uint8_t *)VARDATA_ANY(inb), VARSIZE_ANY_EXHDR(inb), _realloc);
+	if (decoder == NULL)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
 
-	memcpy(VARDATA_EXTERNAL(ret), out, outn);
+	size_t n = 0;
+	*count = _u8_decoder_count(decoder);
+	if (*count > 0 && (_u8_decoder_read_nulls(decoder, first, &nulls[0], 1, &n) != 0 ||
+			   _u8_decoder_seek(decoder, *count - 1) != 0 ||
+			   _u8_decoder_read_nulls(decoder, last, &nulls[1], 1, &n) != 0))
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
 
-	PG_RETURN_BYTEA_P(ret);
+	_u8_decoder_free(decoder, pfree);
 }
 
-PG_FUNCTION_INFO_V1(timestamp_decode);
-Datum timestamp_decode(PG_FUNCTION_ARGS)
+PG_FUNCTION_INFO_V1(series_count);
+Datum series_count(PG_FUNCTION_ARGS)
+{
+	uint32_t count = 0;
+	uint64_t first = 0, last = 0;
+	bool nulls[2];
+	series_bounds(PG_GETARG_DATUM(0), false, &count, &first, &last, nulls);
+	PG_RETURN_INT64(count);
+}
+
+// first and last are NULL if the series is empty or the value is null
+PG_FUNCTION_INFO_V1(series_first);
+Datum series_first(PG_FUNCTION_ARGS)
+{
+	uint32_t count = 0;
+	uint64_t first = 0, last = 0;
+	bool nulls[2];
+	series_bounds(PG_GETARG_DATUM(0), false, &count, &first, &last, nulls);
+	if (count == 0 || nulls[0])
+		PG_RETURN_NULL();
+
+	PG_RETURN_INT64(first);
+}
+
+PG_FUNCTION_INFO_V1(series_last);
+Datum series_last(PG_FUNCTION_ARGS)
+{
+	uint32_t count = 0;
+	uint64_t first = 0, last = 0;
+	bool nulls[2];
+	series_bounds(PG_GETARG_DATUM(0), true, &count, &first, &last, nulls);
+	if (count == 0 || nulls[1])
+		PG_RETURN_NULL();
+
+	PG_RETURN_INT64(last);
+}
+
+// [first, last] of a series of sorted timestamps, NULL if empty. a null bound
+// is unbounded.
+PG_FUNCTION_INFO_V1(series_time_range);
+Datum series_time_range(PG_FUNCTION_ARGS)
+{
+	uint32_t count = 0;
+	uint64_t first = 0, last = 0;
+	bool nulls[2];
+	series_bounds(PG_GETARG_DATUM(0), true, &count, &first, &last, nulls);
+	if (count == 0)
+		PG_RETURN_NULL();
+
+	TypeCacheEntry *typcache = lookup_type_cache(TSRANGEOID, TYPECACHE_RANGE_INFO);
+	RangeBound lower = {.val = TimestampGetDatum(first), .infinite = false, .inclusive = true, .lower = true};
+	RangeBound upper = {.val = TimestampGetDatum(last), .infinite = false, .inclusive = true, .lower = false};
+	lower.infinite = nulls[0], lower.inclusive = !nulls[0];
+	upper.infinite = nulls[1], upper.inclusive = !nulls[1];
+#if PG_VERSION_NUM >= 160000
+	PG_RETURN_RANGE_P(make_range(typcache, &lower, &upper, false, NULL));
+#else
+	PG_RETURN_RANGE_P(make_range(typcache, &lower, &upper, false));
+#endif
+}
+
+// append the values to an encoded series. the full blocks are copied, only the
+// last block is decoded and encoded again with the new values
+PG_FUNCTION_INFO_V1(u8_append);
+Datum u8_append(PG_FUNCTION_ARGS)
 {
 	bytea *inb = PG_GETARG_BYTEA_P(0);
-	int32_t inn = VARSIZE_ANY_EXHDR(inb);
+	ArrayType *in = PG_GETARG_ARRAYTYPE_P(1);
 
-	uint8_t *in = (uint8_t *)VARDATA_ANY(inb);
-	uint64_t *out = NULL;
+	U8Encoder *e = _u8_encoder_open((uint8_t *)VARDATA_ANY(inb), VARSIZE_ANY_EXHDR(inb), _realloc);
+	if (e == NULL)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8 encoded data")));
+
+	if (_u8_encoder_append_nulls(e, ARRPTR(in), ARR_NULLBITMAP(in), ARRNELEMS(in)) != 0)
+		ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED), errmsg("too many values to encode")));
+
+	uint8_t *out = NULL;
 	size_t outn = 0;
+	if (_u8_encoder_finish(e, &out, &outn) != 0)
+		ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("failed to compress the encoded data")));
+
+	PG_RETURN_BYTEA_P(bytea_from(out, outn));
+}
+
+// the state of u8_agg/timestamp_agg is an U8Encoder allocated in the aggregate
+// context, each row is appended to the bitstream directly. the buffers of the
+// encoder grow in the context they are allocated in, so every call that may
+// allocate runs in the aggregate context.
+PG_FUNCTION_INFO_V1(u8_agg_transfn);
+Datum u8_agg_transfn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "u8_agg_transfn called in non-aggregate context");
+
+	MemoryContext old = MemoryContextSwitchTo(aggcontext);
+
+	U8Encoder *state = PG_ARGISNULL(0) ? NULL : (U8Encoder *)PG_GETARG_POINTER(0);
+	if (state == NULL)
+		state = _u8_encoder_create(_realloc);
+
+	// a null row is kept in the runs of nulls
+	if (PG_ARGISNULL(1) ? _u8_encoder_append_null(state) != 0 : _u8_encoder_append(state, PG_GETARG_INT64(1)) != 0)
+		ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED), errmsg("too many values to encode")));
 
-	{
-		uint8_t *a = NULL;
-		size_t an = 0;
-		_zstd_decode(in, inn, &a, &an, _realloc);
-		inn = an;
-		in = a;
+	MemoryContextSwitchTo(old);
+	PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(u8_agg_finalfn);
+Datum u8_agg_finalfn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "u8_agg_finalfn called in non-aggregate context");
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	U8Encoder *state = (U8Encoder *)PG_GETARG_POINTER(0);
+
+	uint8_t *out = NULL;
+	size_t outn = 0;
+
+	MemoryContext old = MemoryContextSwitchTo(aggcontext);
+	if (_u8_encoder_finish(state, &out, &outn) != 0)
+		ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("failed to compress the encoded data")));
+	MemoryContextSwitchTo(old);
+
+	PG_RETURN_BYTEA_P(bytea_from(out, outn));
+}
+
+// the partial states of parallel workers. each worker encodes its chunk to
+// finished blocks, the leader appends the chunks without encoding them again.
+PG_FUNCTION_INFO_V1(u8_agg_combinefn);
+Datum u8_agg_combinefn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "u8_agg_combinefn called in non-aggregate context");
+
+	U8Encoder *state = PG_ARGISNULL(0) ? NULL : (U8Encoder *)PG_GETARG_POINTER(0);
+	U8Encoder *other = PG_ARGISNULL(1) ? NULL : (U8Encoder *)PG_GETARG_POINTER(1);
+	if (other == NULL) {
+		// the partial states of workers without rows, PG_RETURN_POINTER(NULL) is not a null
+		if (state == NULL)
+			PG_RETURN_NULL();
+
+		PG_RETURN_POINTER(state);
 	}
 
-	_u8_decode(in, inn, &out, &outn, _realloc);
+	MemoryContext old = MemoryContextSwitchTo(aggcontext);
 
-	int32_t nbytes = ARR_OVERHEAD_NONULLS(1) + outn;
+	if (state == NULL)
+		state = _u8_encoder_create(_realloc);
 
-	ArrayType *ret = (ArrayType *)palloc0(nbytes);
+	if (_u8_encoder_merge(state, other) != 0)
+		ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED), errmsg("too many values to encode")));
 
-	SET_VARSIZE(ret, nbytes);
-	ARR_NDIM(ret) = 1;
-	ret->dataoffset = 0;
-	ARR_ELEMTYPE(ret) = INT8OID;
-	ARR_DIMS(ret)[0] = outn / sizeof(Timestamp);
+	MemoryContextSwitchTo(old);
+	PG_RETURN_POINTER(state);
+}
+
+PG_FUNCTION_INFO_V1(u8_agg_serialfn);
+Datum u8_agg_serialfn(PG_FUNCTION_ARGS)
+{
+	U8Encoder *state = (U8Encoder *)PG_GETARG_POINTER(0);
+
+	uint8_t *out = NULL;
+	size_t outn = 0;
+	_u8_encoder_serialize(state, &out, &outn);
+
+	PG_RETURN_BYTEA_P(bytea_from(out, outn));
+}
+
+PG_FUNCTION_INFO_V1(u8_agg_deserialfn);
+Datum u8_agg_deserialfn(PG_FUNCTION_ARGS)
+{
+	bytea *inb = PG_GETARG_BYTEA_PP(0);
+
+	U8Encoder *state = _u8_encoder_deserialize((uint8_t *)VARDATA_ANY(inb), VARSIZE_ANY_EXHDR(inb), _realloc);
+	if (state == NULL)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid u8_agg state")));
+
+	PG_RETURN_POINTER(state);
+}
+
+// the decimal series of float8, or the gorilla XOR compressed by the second
+// stage when the values are not decimals
+static bytea *f8_encode_array(ArrayType *in, uint32_t dictionary)
+{
+	uint8_t *out = NULL;
+	size_t outn = 0;
 
-	for (int i = 0; i < outn / sizeof(Timestamp); i++) {
-		((Timestamp *)ARRPTR(ret))[i] = TimestampTzGetDatum(out[i]);
+	if (_f8_series_encode_nulls((float64_t *)ARR_DATA_PTR(in), ARR_NULLBITMAP(in), ARRNELEMS(in), dictionary, &out,
+				    &outn, _realloc_varlena) != 0)
+		ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED), errmsg("too many values to encode")));
+
+	return bytea_of_output(out, outn);
+}
+
+// the runs of a value with nulls are read to the null bitmap of the array, the
+// values after them are decoded as without nulls
+static ArrayType *array_from_f8(bytea *inb)
+{
+	uint8_t *in = (uint8_t *)VARDATA_ANY(inb), *values = in;
+	size_t inn = VARSIZE_ANY_EXHDR(inb), values_sz = inn;
+	uint32_t count = 0, nvalid = 0;
+	ArrayType *ret = NULL;
+
+	if (_nulls_exist(in, inn)) {
+		if (_nulls_read(in, inn, &count, &nvalid, NULL, &values, &values_sz) != 0)
+			ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid f8 encoded data")));
+
+		ret = array_alloc_nulls(count, nvalid, FLOAT8OID);
+		_nulls_read(in, inn, &count, &nvalid, ARR_NULLBITMAP(ret), &values, &values_sz);
 	}
 
-	PG_RETURN_ARRAYTYPE_P(ret);
+	float64_t *out = NULL;
+	size_t outn = 0;
+
+	if (_f8_series_decode(values, values_sz, &out, &outn, _realloc) != 0 || (ret != NULL && outn != nvalid * 8))
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid f8 encoded data")));
+
+	if (ret == NULL)
+		return array_from_8bytes(out, outn / sizeof(float64_t), FLOAT8OID);
+
+	if (nvalid > 0)
+		memcpy(ARR_DATA_PTR(ret), out, outn);
+
+	return ret;
 }
 
 PG_FUNCTION_INFO_V1(f8_encode);
 Datum f8_encode(PG_FUNCTION_ARGS)
 {
-	//
-	PG_RETURN_BYTEA_P(0);
+	PG_RETURN_BYTEA_P(f8_encode_array(PG_GETARG_ARRAYTYPE_P(0), dictionary_arg(fcinfo, 1)));
 }
 
 PG_FUNCTION_INFO_V1(f8_decode);
-Datum f8_decode(PG_FUNCTION_ARGS)
+Datum f8_decode(PG_FUNCTION_ARGS) { PG_RETURN_ARRAYTYPE_P(array_from_f8(PG_GETARG_BYTEA_P(0))); }
+
+// rowgroup_encode stores ctime and the columns of an archived row in one value,
+// column 0 is ctime and the variadic columns follow. every column is encoded
+// as the encode function of its type does, the directory records the type.
+PG_FUNCTION_INFO_V1(rowgroup_encode);
+Datum rowgroup_encode(PG_FUNCTION_ARGS)
 {
-	//
-	PG_RETURN_DATUM(0);
+	if (get_fn_expr_variadic(fcinfo->flinfo))
+		ereport(ERROR,
+			(errcode(ERRCODE_FEATURE_NOT_SUPPORTED), errmsg("columns must be passed as separate arguments")));
+
+	int ncolumns = PG_NARGS();
+	uint8_t **columns = palloc(ncolumns * sizeof(uint8_t *));
+	size_t *column_sizes = palloc(ncolumns * sizeof(size_t));
+	uint32_t *types = palloc(ncolumns * sizeof(uint32_t));
+	ArrayType *ctime = PG_GETARG_ARRAYTYPE_P(0);
+	int32_t count = ARRNELEMS(ctime);
+
+	for (int i = 0; i < ncolumns; ++i) {
+		Oid argtype = get_fn_expr_argtype(fcinfo->flinfo, i);
+		if (argtype != INT8ARRAYOID && argtype != TIMESTAMPARRAYOID && argtype != FLOAT8ARRAYOID)
+			ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+					errmsg("column %d must be bigint[], timestamp[] or double precision[]", i)));
+
+		ArrayType *in = i == 0 ? ctime : PG_GETARG_ARRAYTYPE_P(i);
+		if (ARRNELEMS(in) != count)
+			ereport(ERROR, (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+					errmsg("ctime has %d values but column %d has %d", count, i, ARRNELEMS(in))));
+
+		if (argtype == FLOAT8ARRAYOID) {
+			bytea *b = f8_encode_array(in, 0);
+			columns[i] = (uint8_t *)VARDATA(b);
+			column_sizes[i] = VARSIZE(b) - VARHDRSZ;
+		} else if (_u8_series_encode_nulls(ARRPTR(in), ARR_NULLBITMAP(in), count, 0, &columns[i], &column_sizes[i],
+						   _realloc) != 0) {
+			ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED), errmsg("too many values to encode")));
+		}
+
+		types[i] = ARR_ELEMTYPE(in);
+	}
+
+	uint8_t *out = NULL;
+	size_t outn = 0;
+	if (_rowgroup_encode(count, ncolumns, columns, column_sizes, types, &out, &outn, _realloc_varlena) != 0)
+		ereport(ERROR, (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED), errmsg("too many values to encode")));
+
+	PG_RETURN_BYTEA_P(bytea_of_output(out, outn));
+}
+
+// the bytes of one column are fetched by slices: the prefix for the size of the
+// directory, the directory, then the column. a row group stored external only
+// reads the toast chunks of the directory and of the column.
+static bytea *rowgroup_column_slice(FunctionCallInfo fcinfo, Oid *type)
+{
+	int32 col = PG_GETARG_INT32(1);
+
+	bytea *prefix = PG_GETARG_BYTEA_P_SLICE(0, 0, ROWGROUP_PREFIX_SZ);
+	uint32_t count = 0;
+	uint16_t ncolumns = 0;
+	int directory_sz =
+	    _rowgroup_directory_size((uint8_t *)VARDATA_ANY(prefix), VARSIZE_ANY_EXHDR(prefix), &count, &ncolumns);
+	if (directory_sz < 0)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid row group")));
+
+	if (col < 0 || col >= ncolumns)
+		ereport(ERROR, (errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+				errmsg("column %d does not exist, the row group has %d columns", col, ncolumns)));
+
+	bytea *directory = PG_GETARG_BYTEA_P_SLICE(0, 0, directory_sz);
+	uint32_t coltype = 0;
+	size_t offset = 0, size = 0;
+	if (_rowgroup_column((uint8_t *)VARDATA_ANY(directory), VARSIZE_ANY_EXHDR(directory), col, &coltype, &offset,
+			     &size) != 0)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid row group")));
+
+	bytea *column = PG_GETARG_BYTEA_P_SLICE(0, offset, size);
+	if (VARSIZE_ANY_EXHDR(column) != size)
+		ereport(ERROR, (errcode(ERRCODE_DATA_CORRUPTED), errmsg("invalid row group")));
+
+	*type = coltype;
+	return column;
+}
+
+// the encoded column, the same value as the encode function of its type returns
+PG_FUNCTION_INFO_V1(rowgroup_column);
+Datum rowgroup_column(PG_FUNCTION_ARGS)
+{
+	Oid type = InvalidOid;
+	PG_RETURN_BYTEA_P(rowgroup_column_slice(fcinfo, &type));
+}
+
+// bigint and timestamp columns are both u8 series, they decode as either type
+static bytea *rowgroup_column_of(FunctionCallInfo fcinfo, Oid elemtype)
+{
+	Oid type = InvalidOid;
+	bytea *column = rowgroup_column_slice(fcinfo, &type);
+	if ((elemtype == FLOAT8OID) != (type == FLOAT8OID))
+		ereport(ERROR, (errcode(ERRCODE_DATATYPE_MISMATCH),
+				errmsg("column %d is %s", PG_GETARG_INT32(1), format_type_be(type))));
+
+	return column;
+}
+
+PG_FUNCTION_INFO_V1(rowgroup_u8_decode);
+Datum rowgroup_u8_decode(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_ARRAYTYPE_P(array_from_u8_series(rowgroup_column_of(fcinfo, INT8OID), INT8OID));
+}
+
+PG_FUNCTION_INFO_V1(rowgroup_timestamp_decode);
+Datum rowgroup_timestamp_decode(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_ARRAYTYPE_P(array_from_u8_series(rowgroup_column_of(fcinfo, TIMESTAMPOID), TIMESTAMPOID));
+}
+
+PG_FUNCTION_INFO_V1(rowgroup_f8_decode);
+Datum rowgroup_f8_decode(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_ARRAYTYPE_P(array_from_f8(rowgroup_column_of(fcinfo, FLOAT8OID)));
+}
+
+// train a dictionary from the encoded values and store it to ts.dictionary,
+// the id of the dictionary is returned
+PG_FUNCTION_INFO_V1(train_dictionary);
+Datum train_dictionary(PG_FUNCTION_ARGS)
+{
+	ArrayType *in = PG_GETARG_ARRAYTYPE_P(0);
+	int32 size = PG_GETARG_INT32(1);
+
+	if (size < 256)
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("dictionary size must be at least 256")));
+
+	int16 typlen;
+	bool typbyval;
+	char typalign;
+	get_typlenbyvalalign(BYTEAOID, &typlen, &typbyval, &typalign);
+
+	Datum *elems;
+	bool *nulls;
+	int n = 0;
+	deconstruct_array(in, BYTEAOID, typlen, typbyval, typalign, &elems, &nulls, &n);
+
+	uint8_t **inputs = palloc(Max(n, 1) * sizeof(uint8_t *));
+	size_t *input_sizes = palloc(Max(n, 1) * sizeof(size_t)), ninputs = 0;
+	for (int i = 0; i < n; ++i) {
+		if (nulls[i])
+			continue;
+
+		bytea *b = DatumGetByteaPP(elems[i]);
+		inputs[ninputs] = (uint8_t *)VARDATA_ANY(b);
+		input_sizes[ninputs++] = VARSIZE_ANY_EXHDR(b);
+	}
+
+	uint8_t *dict = NULL;
+	size_t dict_sz = 0;
+	if (_zstd_dictionary_train(inputs, input_sizes, ninputs, size, &dict, &dict_sz, _realloc) != 0)
+		ereport(ERROR, (errcode(ERRCODE_INVALID_PARAMETER_VALUE), errmsg("not enough samples to train a dictionary")));
+
+	int64 id = _zstd_dictionary_id(dict, dict_sz);
+	Oid argtypes[2] = {INT8OID, BYTEAOID};
+	Datum args[2] = {Int64GetDatum(id), PointerGetDatum(bytea_from(dict, dict_sz))};
+
+	SPI_connect();
+	if (SPI_execute_with_args("insert into ts.dictionary (id, dictionary) values ($1, $2)", 2, argtypes, args, NULL,
+				  false, 0) != SPI_OK_INSERT)
+		ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR), errmsg("failed to store the dictionary")));
+	SPI_finish();
+
+	PG_RETURN_INT64(id);
 }
@@ -0,0 +1,558 @@
+// the benchmark of the codecs on generated metrics modelled on the columns of
+// gpcc_system_history, sampled every 15 seconds. the throughput is the best
+// of several rounds, the results are written as json and compared with a
+// saved baseline, a codec which compresses worse fails. the throughput depends
+// on the machine, it is only compared when a tolerance is given.
+#include <stdbool.h>
+#include <stdint.h>
+typedef double float64_t;
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+extern int _u8_encode(
+    uint64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _u8_series_encode(
+    uint64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _u8_series_decode(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _f8_encode(
+    float64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _f8_decode(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _f8_series_encode(
+    float64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _f8_series_decode(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int ref_u8_encode(
+    uint64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int ref_u8_decode(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _zstd_encode(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _zstd_decode(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _zstd_encode_adaptive(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _zstd_decode_adaptive(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+enum { TE_CODEC_AUTO = 0, TE_CODEC_PFOR = 1 };
+extern void _u8_set_codec(int codec);
+
+static void *bench_realloc(void *old_ptr, size_t old_sz __attribute__((unused)), size_t new_sz)
+{
+	if (old_ptr == NULL)
+		return malloc(new_sz);
+
+	return realloc(old_ptr, new_sz);
+}
+
+static double now_ns()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)t.tv_sec * 1e9 + (double)t.tv_nsec;
+}
+
+// the generated data is the same on every run, rand() is not used
+static uint64_t rng_state = 0x9E3779B97F4A7C15;
+
+static uint64_t rng()
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static int64_t rng_range(int64_t lo, int64_t hi) { return lo + (int64_t)(rng() % (uint64_t)(hi - lo + 1)); }
+
+#define QUANTUM_US (15 * 1000000LL)
+
+// ctime: every 15 seconds with up to 50ms of jitter, one sample of 500 is missed
+static void gen_ctime(uint64_t *v, size_t n)
+{
+	int64_t t = 720000000000000; // 2022-10-26, microseconds since 2000
+	for (size_t i = 0; i < n; ++i) {
+		t += QUANTUM_US * (rng() % 500 == 0 ? 2 : 1);
+		v[i] = t + rng_range(0, 50000);
+	}
+}
+
+// sample_time: the schedule of every 15 seconds truncated to the second, one
+// sample of 500 is missed and one of 100 is a second late
+static void gen_sample_time(uint64_t *v, size_t n)
+{
+	int64_t t = 720000000000000;
+	for (size_t i = 0; i < n; ++i) {
+		t += QUANTUM_US * (rng() % 500 == 0 ? 2 : 1);
+		v[i] = t + (rng() % 100 == 0) * 1000000;
+	}
+}
+
+// mem_total: the same value for the whole series
+static void gen_mem_total(uint64_t *v, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		v[i] = 67108864; // 64GiB in KiB
+}
+
+// mem_used: a gauge walking around 24GiB in KiB
+static void gen_mem_used(uint64_t *v, size_t n)
+{
+	int64_t x = 25165824;
+	for (size_t i = 0; i < n; ++i)
+		v[i] = x = x + rng_range(-65536, 65536);
+}
+
+// swap_page_in: a counter which grows in rare bursts
+static void gen_swap_page_in(uint64_t *v, size_t n)
+{
+	int64_t x = 1000;
+	for (size_t i = 0; i < n; ++i)
+		v[i] = x = x + (rng() % 200 == 0 ? rng_range(1, 4096) : 0);
+}
+
+// disk_rb_rate: small background reads with spikes of large scans
+static void gen_disk_rb_rate(uint64_t *v, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		v[i] = rng() % 50 == 0 ? rng_range(10000000, 500000000) : rng_range(0, 65536);
+}
+
+// net_wb_rate: a daily cycle with noise
+static void gen_net_wb_rate(uint64_t *v, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		v[i] = 50000000 + 40000000 * sin(2 * M_PI * i / 5760.0) + rng_range(-2000000, 2000000);
+}
+
+// cpu_user: a percentage with 2 decimal digits
+static void gen_cpu_user(uint64_t *v, size_t n)
+{
+	int64_t x = 2500;
+	for (size_t i = 0; i < n; ++i) {
+		x += rng_range(-300, 300);
+		x = x < 0 ? 0 : x > 10000 ? 10000 : x;
+		float64_t f = x / 100.0;
+		memcpy(v + i, &f, 8);
+	}
+}
+
+// load0: the load average with 2 decimal digits, smooth
+static void gen_load0(uint64_t *v, size_t n)
+{
+	int64_t x = 150;
+	for (size_t i = 0; i < n; ++i) {
+		x += rng_range(-5, 5);
+		x = x < 0 ? 0 : x;
+		float64_t f = x / 100.0;
+		memcpy(v + i, &f, 8);
+	}
+}
+
+typedef struct Dataset {
+	const char *name;
+	bool is_float;
+	void (*gen)(uint64_t *v, size_t n);
+} Dataset;
+
+static const Dataset datasets[] = {
+    {"ctime", false, gen_ctime},
+    {"sample_time", false, gen_sample_time},
+    {"mem_total", false, gen_mem_total},
+    {"mem_used", false, gen_mem_used},
+    {"swap_page_in", false, gen_swap_page_in},
+    {"disk_rb_rate", false, gen_disk_rb_rate},
+    {"net_wb_rate", false, gen_net_wb_rate},
+    {"cpu_user", true, gen_cpu_user},
+    {"load0", true, gen_load0},
+};
+
+// the codecs take the values and return the encoded bytes, the decoded values
+// are in the output of decode
+static int series_encode(uint64_t *v, size_t n, unsigned char **out, size_t *out_sz)
+{
+	return _u8_series_encode(v, n, out, out_sz, bench_realloc);
+}
+
+static int series_decode(unsigned char *in, size_t in_sz, unsigned char **out, size_t *out_sz)
+{
+	return _u8_series_decode(in, in_sz, out, out_sz, bench_realloc);
+}
+
+static int pfor_encode(uint64_t *v, size_t n, unsigned char **out, size_t *out_sz)
+{
+	_u8_set_codec(TE_CODEC_PFOR);
+	int ret = _u8_series_encode(v, n, out, out_sz, bench_realloc);
+	_u8_set_codec(TE_CODEC_AUTO);
+	return ret;
+}
+
+// the byte at a time reference of the delta of delta, without zstd
+static int ref_encode(uint64_t *v, size_t n, unsigned char **out, size_t *out_sz)
+{
+	return ref_u8_encode(v, n, out, out_sz, bench_realloc);
+}
+
+static int ref_decode(unsigned char *in, size_t in_sz, unsigned char **out, size_t *out_sz)
+{
+	return ref_u8_decode(in, in_sz, out, out_sz, bench_realloc);
+}
+
+static int f8_encode(uint64_t *v, size_t n, unsigned char **out, size_t *out_sz)
+{
+	unsigned char *bitstream = NULL;
+	size_t bitstream_sz = 0;
+	int ret = _f8_encode((float64_t *)v, n, &bitstream, &bitstream_sz, bench_realloc);
+	ret |= _zstd_encode_adaptive(bitstream, bitstream_sz, 0, out, out_sz, bench_realloc);
+	free(bitstream);
+	return ret;
+}
+
+static int f8_decode(unsigned char *in, size_t in_sz, unsigned char **out, size_t *out_sz)
+{
+	unsigned char *bitstream = NULL;
+	size_t bitstream_sz = 0;
+	int ret = _zstd_decode_adaptive(in, in_sz, &bitstream, &bitstream_sz, bench_realloc);
+	ret |= _f8_decode(bitstream, bitstream_sz, out, out_sz, bench_realloc);
+	if (bitstream != in)
+		free(bitstream);
+	return ret;
+}
+
+// the decimal series, the output of ts.f8_encode
+static int decimal_encode(uint64_t *v, size_t n, unsigned char **out, size_t *out_sz)
+{
+	return _f8_series_encode((float64_t *)v, n, out, out_sz, bench_realloc);
+}
+
+static int decimal_decode(unsigned char *in, size_t in_sz, unsigned char **out, size_t *out_sz)
+{
+	return _f8_series_decode(in, in_sz, out, out_sz, bench_realloc);
+}
+
+// zstd of the raw values, the reference of a general purpose compressor
+static int zstd_encode(uint64_t *v, size_t n, unsigned char **out, size_t *out_sz)
+{
+	return _zstd_encode((unsigned char *)v, n * 8, out, out_sz, bench_realloc);
+}
+
+static int zstd_decode(unsigned char *in, size_t in_sz, unsigned char **out, size_t *out_sz)
+{
+	return _zstd_decode(in, in_sz, out, out_sz, bench_realloc);
+}
+
+typedef struct Codec {
+	const char *name;
+	bool for_float, for_int;
+	int (*encode)(uint64_t *v, size_t n, unsigned char **out, size_t *out_sz);
+	int (*decode)(unsigned char *in, size_t in_sz, unsigned char **out, size_t *out_sz);
+} Codec;
+
+static const Codec codecs[] = {
+    {"series", false, true, series_encode, series_decode},
+    {"pfor", false, true, pfor_encode, series_decode},
+    {"ref", false, true, ref_encode, ref_decode},
+    {"f8", true, false, f8_encode, f8_decode},
+    {"decimal", true, false, decimal_encode, decimal_decode},
+    {"zstd", true, true, zstd_encode, zstd_decode},
+};
+
+// one host-hour, one host-day and one host-month at 15 seconds
+static const size_t lengths[] = {240, 5760, 172800};
+
+// every length is run until this many values are encoded, at least 5 rounds
+#define BENCH_VALUES (4 * 1024 * 1024)
+
+typedef struct Result {
+	char dataset[32], codec[32];
+	size_t length;
+	double encode_mbps, decode_mbps, encode_ns, decode_ns, ratio;
+} Result;
+
+static bool bench(const Dataset *d, const Codec *c, size_t n, Result *r)
+{
+	uint64_t *input = malloc(n * 8);
+	rng_state = 0x9E3779B97F4A7C15;
+	d->gen(input, n);
+
+	size_t nround = BENCH_VALUES / n < 5 ? 5 : BENCH_VALUES / n;
+	double encode_best = INFINITY, decode_best = INFINITY;
+	size_t encoded_sz = 0;
+	bool match = true;
+
+	for (size_t round = 0; round < nround && match; ++round) {
+		unsigned char *encoded = NULL, *decoded = NULL;
+		size_t decoded_sz = 0;
+
+		double start = now_ns();
+		int ret = c->encode(input, n, &encoded, &encoded_sz);
+		double mid = now_ns();
+		ret |= c->decode(encoded, encoded_sz, &decoded, &decoded_sz);
+		double end = now_ns();
+
+		encode_best = mid - start < encode_best ? mid - start : encode_best;
+		decode_best = end - mid < decode_best ? end - mid : decode_best;
+		match = ret == 0 && decoded_sz == n * 8 && memcmp(decoded, input, n * 8) == 0;
+
+		free(encoded), free(decoded);
+	}
+
+	*r = (Result){
+	    .length = n,
+	    .encode_mbps = n * 8 / (encode_best / 1e9) / 1e6,
+	    .decode_mbps = n * 8 / (decode_best / 1e9) / 1e6,
+	    .encode_ns = encode_best / n,
+	    .decode_ns = decode_best / n,
+	    .ratio = (double)n * 8 / encoded_sz,
+	};
+	snprintf(r->dataset, sizeof(r->dataset), "%s", d->name);
+	snprintf(r->codec, sizeof(r->codec), "%s", c->name);
+
+	free(input);
+	return match;
+}
+
+#define RESULT_FORMAT                                                                                                  \
+	"{\"dataset\": \"%s\", \"codec\": \"%s\", \"length\": %zu, \"encode_mbps\": %.2f, \"decode_mbps\": %.2f, "     \
+	"\"encode_ns_per_value\": %.3f, \"decode_ns_per_value\": %.3f, \"ratio\": %.3f}"
+
+// the results are written one per line, so the baseline is read back by lines
+#define RESULT_SCAN_FORMAT                                                                                             \
+	" {\"dataset\": \"%31[^\"]\", \"codec\": \"%31[^\"]\", \"length\": %zu, \"encode_mbps\": %lf, "                \
+	"\"decode_mbps\": %lf, \"encode_ns_per_value\": %lf, \"decode_ns_per_value\": %lf, \"ratio\": %lf"
+
+static bool write_results(const char *path, Result *results, size_t n)
+{
+	FILE *f = fopen(path, "w");
+	if (f == NULL)
+		return false;
+
+	fprintf(f, "{\"results\": [\n");
+	for (size_t i = 0; i < n; ++i) {
+		Result *r = &results[i];
+		fprintf(
+		    f,
+		    "  " RESULT_FORMAT "%s\n",
+		    r->dataset,
+		    r->codec,
+		    r->length,
+		    r->encode_mbps,
+		    r->decode_mbps,
+		    r->encode_ns,
+		    r->decode_ns,
+		    r->ratio,
+		    i + 1 < n ? "," : "");
+	}
+	fprintf(f, "]}\n");
+
+	return fclose(f) == 0;
+}
+
+static Result *read_results(const char *path, size_t *n)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return NULL;
+
+	Result *results = NULL;
+	char line[1024];
+	*n = 0;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		Result r;
+		if (sscanf(
+			line,
+			RESULT_SCAN_FORMAT,
+			r.dataset,
+			r.codec,
+			&r.length,
+			&r.encode_mbps,
+			&r.decode_mbps,
+			&r.encode_ns,
+			&r.decode_ns,
+			&r.ratio) != 8)
+			continue;
+
+		results = realloc(results, (*n + 1) * sizeof(Result));
+		results[(*n)++] = r;
+	}
+
+	fclose(f);
+	return results;
+}
+
+// the ratio is deterministic, the throughput is allowed to vary by tolerance,
+// it is not compared when tolerance is negative
+static bool compare(Result *results, size_t n, Result *baseline, size_t nbaseline, double tolerance)
+{
+	bool pass = true;
+	for (size_t i = 0; i < n; ++i) {
+		Result *r = &results[i], *b = NULL;
+		for (size_t j = 0; j < nbaseline && b == NULL; ++j) {
+			if (strcmp(r->dataset, baseline[j].dataset) == 0 && strcmp(r->codec, baseline[j].codec) == 0 &&
+			    r->length == baseline[j].length)
+				b = &baseline[j];
+		}
+
+		if (b == NULL)
+			continue; // a new benchmark
+
+		const char *regression = NULL;
+		if (r->ratio < b->ratio * 0.99)
+			regression = "ratio";
+		else if (tolerance >= 0 && r->encode_mbps < b->encode_mbps * (1 - tolerance))
+			regression = "encode";
+		else if (tolerance >= 0 && r->decode_mbps < b->decode_mbps * (1 - tolerance))
+			regression = "decode";
+
+		if (regression != NULL) {
+			printf(
+			    "regression [%s / %s / %zu] %s: ratio %.3f -> %.3f, encode %.2f -> %.2f MB/s, decode %.2f -> "
+			    "%.2f MB/s\n",
+			    r->dataset,
+			    r->codec,
+			    r->length,
+			    regression,
+			    b->ratio,
+			    r->ratio,
+			    b->encode_mbps,
+			    r->encode_mbps,
+			    b->decode_mbps,
+			    r->decode_mbps);
+			pass = false;
+		}
+	}
+
+	return pass;
+}
+
+static void usage()
+{
+	fprintf(
+	    stderr,
+	    "usage: bench_encode [-o output.json] [-b baseline.json] [-t tolerance]\n"
+	    "\n"
+	    "  -o  write the results, bench.json by default\n"
+	    "  -b  fail if the ratio is worse than the baseline\n"
+	    "  -t  also fail if the throughput is lower than the baseline by more than the tolerance, e.g. 0.5.\n"
+	    "      the baseline must be taken on the same machine\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *output = "bench.json", *baseline_path = NULL;
+	double tolerance = -1; // the throughput is not compared
+
+	for (int opt; (opt = getopt(argc, argv, "o:b:t:")) != -1;) {
+		if (opt == 'o')
+			output = optarg;
+		else if (opt == 'b')
+			baseline_path = optarg;
+		else if (opt == 't')
+			tolerance = atof(optarg);
+		else
+			usage();
+	}
+
+	size_t nresults = 0;
+	Result *results = malloc(sizeof(datasets) / sizeof(datasets[0]) * sizeof(codecs) / sizeof(codecs[0]) *
+				 sizeof(lengths) / sizeof(lengths[0]) * sizeof(Result));
+
+	bool ok = true;
+	printf("%-14s %-8s %8s %12s %12s %10s %10s %8s\n", "dataset", "codec", "length", "encode MB/s", "decode MB/s",
+	       "encode ns", "decode ns", "ratio");
+	for (size_t i = 0; i < sizeof(datasets) / sizeof(datasets[0]); ++i) {
+		const Dataset *d = &datasets[i];
+		for (size_t j = 0; j < sizeof(codecs) / sizeof(codecs[0]); ++j) {
+			const Codec *c = &codecs[j];
+			if (d->is_float ? !c->for_float : !c->for_int)
+				continue;
+
+			for (size_t k = 0; k < sizeof(lengths) / sizeof(lengths[0]); ++k) {
+				Result *r = &results[nresults++];
+				if (!bench(d, c, lengths[k], r)) {
+					printf("round trip not match [%s / %s / %zu]\n", d->name, c->name, lengths[k]);
+					ok = false;
+				}
+
+				printf(
+				    "%-14s %-8s %8zu %12.2f %12.2f %10.3f %10.3f %8.2f\n",
+				    r->dataset,
+				    r->codec,
+				    r->length,
+				    r->encode_mbps,
+				    r->decode_mbps,
+				    r->encode_ns,
+				    r->decode_ns,
+				    r->ratio);
+			}
+		}
+	}
+
+	if (!write_results(output, results, nresults)) {
+		fprintf(stderr, "bench_encode: can not write %s\n", output);
+		return 1;
+	}
+
+	if (baseline_path != NULL) {
+		size_t nbaseline = 0;
+		Result *baseline = read_results(baseline_path, &nbaseline);
+		if (baseline == NULL) {
+			fprintf(stderr, "bench_encode: can not read %s\n", baseline_path);
+			return 1;
+		}
+
+		ok &= compare(results, nresults, baseline, nbaseline, tolerance);
+		free(baseline);
+	}
+
+	free(results);
+	return !ok;
+}
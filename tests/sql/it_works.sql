@@ -0,0 +1,27 @@
+set client_min_messages = warning;
+create extension if not exists pgts;
+
+-- the blocks of this series are compressed by zstd, the scratch of the decoder
+-- must live across the rows of the set returning functions
+create temp table zst as select i, (i * 7919 % 1000003)::bigint * 1000 + i % 17 as v from generate_series(1, 20000) i;
+create temp table zst_encoded as select ts.u8_encode(array_agg(v order by i)) as v from zst;
+select array(select ts.u8_unnest(v) from zst_encoded) = array(select v from zst order by i) as unnest_same;
+select array(select u from zst_encoded, ts.u8_unnest(zst_encoded.v) u) = array(select v from zst order by i) as unnest_from_same;
+
+-- decode_between reads the blocks after the first one in later calls
+create temp table zst_window as select ts.timestamp_encode(array_agg('2022-11-01'::timestamp + i * interval '15 seconds' order by i)) as ctime, ts.u8_encode(array_agg(v order by i)) as val from zst;
+select array(select r.value from zst_window, ts.decode_between(ctime, val, '2022-11-01 00:00:15', '2022-11-04 11:20:00') r) = array(select v from zst order by i) as between_same;
+
+-- the partial states of the workers are null when there are no rows
+create table agg_empty (v bigint, ctime timestamp);
+set parallel_setup_cost = 0;
+set parallel_tuple_cost = 0;
+set min_parallel_table_scan_size = 0;
+set max_parallel_workers_per_gather = 2;
+select ts.u8_agg(v) is null as agg_empty_null from agg_empty;
+select ts.timestamp_agg(ctime) is null as timestamp_agg_empty_null from agg_empty;
+reset parallel_setup_cost;
+reset parallel_tuple_cost;
+reset min_parallel_table_scan_size;
+reset max_parallel_workers_per_gather;
+drop table agg_empty;
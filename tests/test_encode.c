@@ -6,7 +6,7 @@ typedef double float64_t;
 #include <stdlib.h>
 #include <string.h>
 #include <sys/param.h> // for MIN/MAX
-#include <time.h>
+#include <zstd.h> // for the frames of unknown size
 
 extern int _u8_encode(
     uint64_t *input, size_t input_sz,		  //
@@ -19,6 +19,178 @@ extern int _u8_decode(
     void *(*realloc_func)(void *, size_t, size_t) //
 );
 
+extern int _u8_series_encode(
+    uint64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _u8_series_encode_dict(
+    uint64_t *input, size_t input_sz,		  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _u8_series_decode(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _u8_series_slice(
+    unsigned char *input, size_t input_sz,	  //
+    size_t start, size_t count,			  //
+    uint64_t **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _u8_series_encode_nulls(
+    uint64_t *input,				  //
+    uint8_t *validity, size_t count,		  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern bool _nulls_exist(unsigned char *input, size_t input_sz);
+extern int _nulls_read(
+    unsigned char *input, size_t input_sz,    //
+    uint32_t *count, uint32_t *nvalid,	      //
+    uint8_t *validity,			      //
+    unsigned char **values, size_t *values_sz //
+);
+
+extern int _u8_series_search(
+    unsigned char *input, size_t input_sz,	  //
+    int64_t lo, int64_t hi,			  //
+    size_t *start, size_t *count,		  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _u8_series_count(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t *count,				  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _u8_series_sum(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t *count, __int128 *sum,		  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _u8_series_min_max(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t *count, int64_t *min, int64_t *max,  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+typedef struct U8Encoder U8Encoder;
+extern U8Encoder *_u8_encoder_create(void *(*realloc_func)(void *, size_t, size_t));
+extern void _u8_encoder_free(U8Encoder *e, void (*free_func)(void *));
+extern int _u8_encoder_append(U8Encoder *e, uint64_t value);
+extern int _u8_encoder_append_n(U8Encoder *e, uint64_t *values, size_t n);
+extern int _u8_encoder_append_null(U8Encoder *e);
+extern int _u8_encoder_append_nulls(U8Encoder *e, uint64_t *values, uint8_t *validity, size_t count);
+extern int _u8_encoder_finish(U8Encoder *e, unsigned char **output, size_t *output_sz);
+extern int _u8_encoder_merge(U8Encoder *e, U8Encoder *other);
+extern int _u8_encoder_serialize(U8Encoder *e, unsigned char **output, size_t *output_sz);
+extern U8Encoder *_u8_encoder_open(
+    unsigned char *input, size_t input_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern U8Encoder *_u8_encoder_deserialize(
+    unsigned char *input, size_t input_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+typedef struct U8Decoder U8Decoder;
+extern U8Decoder *_u8_decoder_create(
+    unsigned char *input, size_t input_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern void _u8_decoder_free(U8Decoder *d, void (*free_func)(void *));
+extern uint32_t _u8_decoder_count(U8Decoder *d);
+extern int _u8_decoder_read(U8Decoder *d, uint64_t *output, size_t n, size_t *output_n);
+extern int _u8_decoder_read_nulls(U8Decoder *d, uint64_t *output, bool *nulls, size_t n, size_t *output_n);
+extern int _u8_decoder_seek(U8Decoder *d, size_t position);
+
+typedef struct TimeBucket {
+	int64_t start;
+	uint32_t count;
+	__int128 sum;
+	int64_t min, max, first, last;
+} TimeBucket;
+typedef struct U8Bucketer U8Bucketer;
+extern U8Bucketer *_u8_bucketer_create(
+    unsigned char *ctime, size_t ctime_sz,	   //
+    unsigned char *val, size_t val_sz,		   //
+    int64_t width,				   //
+    void *(*realloc_func)(void *, size_t, size_t), //
+    void (*free_func)(void *)			   //
+);
+extern void _u8_bucketer_free(U8Bucketer *b, void (*free_func)(void *));
+extern int _u8_bucketer_next(U8Bucketer *b, TimeBucket *bucket);
+
+extern int _u8_series_prefix(unsigned char *input, size_t input_sz, uint32_t *count, uint64_t *first);
+extern int _u8_series_tail(unsigned char *input, size_t input_sz, size_t *offset);
+extern int _u8_series_last(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char *tail, size_t tail_sz,	  //
+    uint64_t *last,				  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+extern int _rowgroup_encode(
+    uint32_t count, uint16_t ncolumns,		   //
+    unsigned char **columns, size_t *column_sizes, //
+    uint32_t *types,				   //
+    unsigned char **output, size_t *output_sz,	   //
+    void *(*realloc_func)(void *, size_t, size_t)  //
+);
+extern int _rowgroup_directory_size(unsigned char *input, size_t input_sz, uint32_t *count, uint16_t *ncolumns);
+extern int _rowgroup_column(
+    unsigned char *input, size_t input_sz,	 //
+    uint16_t column,				 //
+    uint32_t *type, size_t *offset, size_t *size //
+);
+
+extern int _f8_encode(
+    float64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _f8_decode(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _f8_series_encode(
+    float64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _f8_series_encode_nulls(
+    float64_t *input,				  //
+    uint8_t *validity, size_t count,		  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _f8_series_decode(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern U8Decoder *_f8_decoder_create(
+    unsigned char *input, size_t input_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+extern int ref_u8_encode(
+    uint64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int ref_u8_decode(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
 extern int _zstd_decode(
     unsigned char *input, size_t input_sz,	  //
     unsigned char **output, size_t *output_sz,	  //
@@ -31,9 +203,41 @@ extern int _zstd_encode(
     void *(*realloc_func)(void *, size_t, size_t) //
 );
 
-static double clock_gettime_ms(struct timespec *s) { return (double)s->tv_sec * 10e3 + (double)s->tv_nsec / 10e3; }
+extern int _zstd_encode_dict(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+enum { TE_CODEC_AUTO = 0, TE_CODEC_PFOR = 1 };
+extern void _u8_set_codec(int codec);
+
+enum { TE_STAGE_NONE = 0, TE_STAGE_ZSTD = 1, TE_STAGE_ZSTD_LONG = 2 };
+extern void _zstd_set_stage(int stage, int level);
+extern int _zstd_encode_adaptive(
+    unsigned char *input, size_t input_sz,	  //
+    uint32_t dictionary,			  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+extern int _zstd_decode_adaptive(
+    unsigned char *input, size_t input_sz,	  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+);
+
+extern int _zstd_dictionary_train(
+    unsigned char **inputs, size_t *input_sizes, size_t n, //
+    size_t dict_cap,					   //
+    unsigned char **output, size_t *output_sz,		   //
+    void *(*realloc_func)(void *, size_t, size_t)	   //
+);
+extern uint32_t _zstd_dictionary_id(unsigned char *dict, size_t dict_sz);
+extern int _zstd_dictionary_load(unsigned char *dict, size_t dict_sz);
+extern void _zstd_dictionary_set_loader(int (*loader)(uint32_t id));
 
-static void *test_realloc(void *old_ptr, size_t old_sz, size_t new_sz)
+static void *test_realloc(void *old_ptr, size_t old_sz __attribute__((unused)), size_t new_sz)
 {
 	if (old_ptr == NULL)
 		return calloc(1, new_sz);
@@ -53,14 +257,51 @@ static void test_print_bytes(char *prefix, unsigned char *p, int size)
 #define PATTERN_RAND 0
 #define PATTERN_ORDERED 1
 #define PATTERN_ZERO 2
+#define PATTERN_MIXED 3 /* delta of delta in every width */
+#define PATTERN_GAUGE 4 /* float random walk with 2 decimal digits */
+#define PATTERN_JITTER 5 /* timestamps of every second with jitter */
+#define PATTERN_STEP 6 /* a counter updated every 100 values */
+#define PATTERN_NOISE 7 /* a random walk with a bounded step */
+#define PATTERN_REGULAR 8 /* timestamps of every 15 seconds with missed and late samples */
+
+static void test_fill(uint64_t *input, size_t input_sz, int pattern)
+{
+	for (size_t i = 0; i < input_sz; ++i) {
+		if (pattern == PATTERN_RAND)
+			input[i] = ((uint64_t)rand() << 32 | rand());
+		else if (pattern == PATTERN_ORDERED)
+			input[i] = i;
+		else if (pattern == PATTERN_ZERO)
+			input[i] = 0;
+		else if (pattern == PATTERN_JITTER)
+			input[i] = 1600000000000000 + (uint64_t)i * 1000000 + rand() % 1000;
+		else if (pattern == PATTERN_STEP)
+			input[i] = i == 0 ? 1000 : input[i - 1] + (i % 100 == 0) * (rand() % 1000 - 500);
+		else if (pattern == PATTERN_NOISE)
+			input[i] = i == 0 ? 1000 : input[i - 1] + rand() % 2001 - 1000;
+		else if (pattern == PATTERN_REGULAR) {
+			// the slot of the previous sample, a late sample is still in its slot
+			uint64_t slot = i == 0 ? 0 : (input[i - 1] - 1600000000000000) / 15000000 + 1 + (rand() % 100 == 0);
+			input[i] = 1600000000000000 + slot * 15000000 + (rand() % 50 == 0) * 1000000;
+		} else if (pattern == PATTERN_GAUGE) {
+			float64_t v = i == 0 ? 50 : ((float64_t *)input)[i - 1] + (rand() % 201 - 100) / 100.0;
+			v = (int64_t)(v * 100) / 100.0;
+			memcpy(input + i, &v, 8);
+		} else if (pattern == PATTERN_MIXED && i < 2)
+			input[i] = rand();
+		else if (pattern == PATTERN_MIXED) {
+			int64_t dd = ((int64_t)rand() << 32 | rand()) >> (rand() % 64);
+			dd = (rand() % 4 == 0) ? 0 : (rand() % 2) ? -dd : dd;
+			input[i] = 2 * input[i - 1] - input[i - 2] + dd;
+		}
+	}
+}
 
 typedef struct Case {
 	const char *name;
 	bool skip;
 	int pattern;
 
-	size_t base;
-
 	unsigned char *in;
 	size_t in_sz;
 
@@ -69,90 +310,304 @@ typedef struct Case {
 
 	typeof(_u8_encode) *u8_encode;
 	typeof(_u8_decode) *u8_decode;
+	typeof(_f8_encode) *f8_encode;
+	typeof(_f8_decode) *f8_decode;
 } Case;
 
 static bool ok = true;
 
-static void run_memcpy()
+// several frames, and frames without the content size written by a stream
+static void run_zstd_frames()
 {
-	printf("running bench  [u8 / memcpy]");
+	printf("running frames [u8 / zstd]");
 
-	struct timespec tstart = {0, 0}, tend = {0, 0};
+	size_t input_sz = 300000, half = input_sz / 2;
+	unsigned char *input = malloc(input_sz);
+	test_fill((uint64_t *)input, input_sz / 8, PATTERN_MIXED);
+
+	size_t cap = ZSTD_compressBound(input_sz) * 2, frames_sz = 0;
+	unsigned char *frames = malloc(cap);
+	frames_sz += ZSTD_compress(frames, cap, input, half, 1);
+
+	ZSTD_CCtx *cctx = ZSTD_createCCtx();
+	ZSTD_CCtx_setParameter(cctx, ZSTD_c_contentSizeFlag, 0);
+	size_t unknown_sz = ZSTD_compress2(cctx, frames + frames_sz, cap - frames_sz, input + half, input_sz - half);
+	ZSTD_freeCCtx(cctx);
+
+	struct {
+		unsigned char *in, *expect;
+		size_t in_sz, expect_sz;
+	} cases[] = {
+	    {frames, input, frames_sz, half},
+	    {frames + frames_sz, input + half, unknown_sz, input_sz - half},
+	    {frames, input, frames_sz + unknown_sz, input_sz},
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+		unsigned char *out = NULL;
+		size_t out_sz = 0;
+		int ret = _zstd_decode(cases[i].in, cases[i].in_sz, &out, &out_sz, test_realloc);
+		if (ret != 0 || out_sz != cases[i].expect_sz || memcmp(out, cases[i].expect, out_sz) != 0) {
+			printf("\n		frames not match with case %zu\n", i);
+			ok = false;
+		}
 
-	uint64_t en_bytes = 0;
-	double en_ms = 0;
+		// truncated input must fail
+		ret = _zstd_decode(cases[i].in, cases[i].in_sz - 1, &out, &out_sz, test_realloc);
+		if (ret == 0) {
+			printf("\n		truncated frames decoded with case %zu\n", i);
+			ok = false;
+		}
 
-	size_t input_sz = 20480 * 8, nround = 5000;
-	uint64_t *input = malloc(input_sz);
-	uint64_t *output = malloc(input_sz);
-	for (int round = 0; round < nround; ++round) {
-		clock_gettime(CLOCK_MONOTONIC, &tstart);
-		memmove(output, input, input_sz);
-		clock_gettime(CLOCK_MONOTONIC, &tend);
-		en_ms = clock_gettime_ms(&tend) - clock_gettime_ms(&tstart);
-		en_bytes += input_sz;
+		free(out);
 	}
 
-	const double _1MiB = 1024 * 1024;
-	const double _1GiB = 1024 * _1MiB;
-	printf(
-	    "\t  ... [%.2fGiB/s | %.2fMiB -> %.2fMiB]\n",
-	    (1.0 * nround * input_sz / _1GiB) / (en_ms / 10e3),
-	    (1.0 * nround * input_sz / _1MiB),
-	    (double)en_bytes / _1MiB);
+	if (ok)
+		printf(" \t  ... OK \n");
+
+	free(input), free(frames);
 }
 
-static void run_zstd()
+// every second stage must round trip, and zstd is never larger than the raw
+// bitstream since it is dropped when it does not pay
+static void run_stage_u8(Case *c)
 {
-	printf("running bench  [u8 / zstd]");
+	if (c->skip)
+		return;
 
-	size_t input_sz = 20480 * 8, nround = 5000;
-	unsigned char *input = malloc(input_sz);
+	printf("running stage  [%s]", c->name);
+
+	size_t input_sz = 20480, raw_sz = 0;
+	uint64_t *input = malloc(input_sz * 8);
+	test_fill(input, input_sz, c->pattern);
+
+	int stages[][2] = {
+	    {TE_STAGE_NONE, 0}, {TE_STAGE_ZSTD, 0}, {TE_STAGE_ZSTD, 1}, {TE_STAGE_ZSTD, 19}, {TE_STAGE_ZSTD_LONG, 0},
+	};
+	for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]) && ok; ++i) {
+		_zstd_set_stage(stages[i][0], stages[i][1]);
+
+		unsigned char *out = NULL, *decoded = NULL, *value = NULL, *value_decoded = NULL;
+		size_t out_sz = 0, decoded_sz = 0, value_sz = 0, value_decoded_sz = 0;
+		int ret = _u8_series_encode(input, input_sz, &out, &out_sz, test_realloc);
+		ret |= _u8_series_decode(out, out_sz, &decoded, &decoded_sz, test_realloc);
+		ret |= _zstd_encode_adaptive((unsigned char *)input, input_sz * 8, 0, &value, &value_sz, test_realloc);
+		ret |= _zstd_decode_adaptive(value, value_sz, &value_decoded, &value_decoded_sz, test_realloc);
+
+		raw_sz = i == 0 ? out_sz : raw_sz;
+		if (ret != 0 || decoded_sz != input_sz * 8 || memcmp(decoded, input, decoded_sz) != 0 ||
+		    value_decoded_sz != input_sz * 8 || memcmp(value_decoded, input, value_decoded_sz) != 0) {
+			printf("\n		round trip not match with stage %d level %d\n", stages[i][0], stages[i][1]);
+			ok = false;
+		} else if (out_sz > raw_sz || value_sz > input_sz * 8) {
+			printf("\n		compressed %zu is larger than raw %zu with stage %d\n", out_sz, raw_sz, stages[i][0]);
+			ok = false;
+		}
 
-	uint64_t en_bytes = 0;
-	double en_ms = 0, de_ms = 0;
+		if (value_decoded != value)
+			free(value_decoded);
+		free(out), free(decoded), free(value);
+	}
 
-	for (int round = 0; round < nround; ++round) {
+	_zstd_set_stage(TE_STAGE_ZSTD, 0);
 
-		unsigned char *out1 = NULL, *out2 = NULL;
-		struct timespec tstart = {0, 0}, tend = {0, 0};
-		size_t out_sz1 = 0, out_sz2 = 0;
+	if (ok)
+		printf(" \t  ... OK \n");
 
-		for (int i = 0; i < input_sz; ++i) {
-			input[i] = rand();
+	free(input);
+}
+
+static unsigned char *test_dict = NULL;
+static size_t test_dict_sz = 0;
+
+static int test_dictionary_loader(uint32_t id)
+{
+	if (test_dict == NULL || _zstd_dictionary_id(test_dict, test_dict_sz) != id)
+		return -1;
+
+	return _zstd_dictionary_load(test_dict, test_dict_sz);
+}
+
+// short series encoded with a trained dictionary, the dictionary is loaded
+// by the loader when it is used the first time
+static void run_dictionary_u8()
+{
+	printf("running dict   [u8 / series / jitter]");
+
+	size_t nseries = 500, input_sz = 64;
+	uint64_t *input = malloc(nseries * input_sz * 8);
+	unsigned char **outs = malloc(nseries * sizeof(unsigned char *));
+	size_t *out_szs = malloc(nseries * sizeof(size_t)), plain_bytes = 0, dict_bytes = 0;
+	for (size_t i = 0; i < nseries; ++i) {
+		test_fill(input + i * input_sz, input_sz, PATTERN_JITTER);
+		_u8_series_encode(input + i * input_sz, input_sz, &outs[i], &out_szs[i], test_realloc);
+		plain_bytes += out_szs[i];
+	}
+
+	_zstd_dictionary_set_loader(test_dictionary_loader);
+	if (_zstd_dictionary_train(outs, out_szs, nseries, 4096, &test_dict, &test_dict_sz, test_realloc) != 0) {
+		printf("\n		dictionary is not trained\n");
+		ok = false;
+	}
+
+	uint32_t id = ok ? _zstd_dictionary_id(test_dict, test_dict_sz) : 0;
+	for (size_t i = 0; i < nseries && ok; ++i) {
+		unsigned char *out = NULL, *decoded = NULL;
+		size_t out_sz = 0, decoded_sz = 0;
+		int ret = _u8_series_encode_dict(input + i * input_sz, input_sz, id, &out, &out_sz, test_realloc);
+		ret |= _u8_series_decode(out, out_sz, &decoded, &decoded_sz, test_realloc);
+		if (ret != 0 || decoded_sz != input_sz * 8 || memcmp(decoded, input + i * input_sz, decoded_sz) != 0) {
+			printf("\n		dictionary round trip not match with series %zu\n", i);
+			ok = false;
 		}
 
-		clock_gettime(CLOCK_MONOTONIC, &tstart);
-		int ret1 = _zstd_encode(input, input_sz, &out1, &out_sz1, test_realloc);
-		clock_gettime(CLOCK_MONOTONIC, &tend);
-		en_ms = clock_gettime_ms(&tend) - clock_gettime_ms(&tstart);
-		en_bytes += out_sz1;
+		// the values without dictionary are still readable
+		free(decoded), decoded = NULL;
+		ret = _u8_series_decode(outs[i], out_szs[i], &decoded, &decoded_sz, test_realloc);
+		if (ret != 0 || memcmp(decoded, input + i * input_sz, decoded_sz) != 0) {
+			printf("\n		plain round trip not match with series %zu\n", i);
+			ok = false;
+		}
+
+		dict_bytes += out_sz;
+		free(out), free(decoded);
+	}
 
-		clock_gettime(CLOCK_MONOTONIC, &tstart);
-		int ret2 = _zstd_decode(out1, out_sz1, &out2, &out_sz2, test_realloc);
-		clock_gettime(CLOCK_MONOTONIC, &tend);
-		de_ms = clock_gettime_ms(&tend) - clock_gettime_ms(&tstart);
+	// a dictionary can not be loaded
+	unsigned char *out = NULL;
+	size_t out_sz = 0;
+	if (_zstd_encode_dict((unsigned char *)input, 64, id + 1, &out, &out_sz, test_realloc) == 0) {
+		printf("\n		encoded with a dictionary not exists\n");
+		ok = false;
+	}
+	free(out);
 
-		if (memcmp(input, out2, input_sz) != 0) {
-			printf("\n		buffer compare not match \n");
-			test_print_bytes("I ", (unsigned char *)input, input_sz * 8);
-			test_print_bytes("O ", (unsigned char *)out2, out_sz2);
+	// a frame without dictionary followed by a frame with it, every frame is
+	// decompressed with its own dictionary, with and without the content size
+	size_t half = nseries * input_sz * 4, cap = ZSTD_compressBound(half) * 2;
+	unsigned char *frames = malloc(cap);
+	for (int unknown = 0; unknown < 2 && ok; ++unknown) {
+		ZSTD_CCtx *cctx = ZSTD_createCCtx();
+		ZSTD_CCtx_setParameter(cctx, ZSTD_c_contentSizeFlag, !unknown);
+		unsigned char *raw = (unsigned char *)input;
+		size_t frames_sz = ZSTD_compress2(cctx, frames, cap, raw, half);
+		ZSTD_CCtx_loadDictionary(cctx, test_dict, test_dict_sz);
+		frames_sz += ZSTD_compress2(cctx, frames + frames_sz, cap - frames_sz, raw + half, half);
+		ZSTD_freeCCtx(cctx);
+
+		unsigned char *decoded = NULL;
+		size_t decoded_sz = 0;
+		int ret = _zstd_decode(frames, frames_sz, &decoded, &decoded_sz, test_realloc);
+		if (ret != 0 || decoded_sz != half * 2 || memcmp(decoded, input, decoded_sz) != 0) {
+			printf("\n		frames of several dictionaries not match with unknown %d\n", unknown);
+			ok = false;
 		}
+		free(decoded);
+	}
+	free(frames);
+
+	if (ok)
+		printf(" \t  ... OK [%.2fKiB -> %.2fKiB]\n", plain_bytes / 1024.0, dict_bytes / 1024.0);
+
+	for (size_t i = 0; i < nseries; ++i)
+		free(outs[i]);
+
+	free(input), free(outs), free(out_szs);
+}
+
+static void run_f8(Case *c)
+{
+	if (c->skip)
+		return;
 
-		free(out1);
-		free(out2);
+	printf("running encode [%s]", c->name);
+
+	size_t out_sz = 0;
+	unsigned char *out = NULL;
+
+	int ret = c->f8_encode((float64_t *)c->in, c->in_sz, &out, &out_sz, test_realloc);
+	if (ret != 0) {
+		printf("\n		error %d", ret);
+		goto err;
 	}
 
-	const double _1MiB = 1024 * 1024;
-	const double _1GiB = 1024 * _1MiB;
-	printf(
-	    "\t  ... [decode %.2fGiB/s encode %.2fGiB/s | %.2fMiB -> %.2fMiB]\n",
-	    (1.0 * nround * input_sz / _1GiB) / (en_ms / 10e3),
-	    (1.0 * nround * input_sz / _1GiB) / (de_ms / 10e3),
-	    (1.0 * nround * input_sz / _1MiB),
-	    (double)en_bytes / _1MiB);
+	// the output is not checked when there is no expect output
+	int size = MIN(c->out_sz, out_sz);
+	if (c->out != NULL && (c->out_sz != out_sz || memcmp(out, c->out, size) != 0)) {
+		printf("\n		buffer compare not match \n");
+		test_print_bytes("actual", out, out_sz);
+		test_print_bytes("expect", c->out, c->out_sz);
+		goto err;
+	}
 
-	free(input);
+	printf(" \t  ... OK \n");
+
+	unsigned char *encoded = out;
+	size_t encoded_sz = out_sz;
+	out_sz = 0;
+	out = NULL;
+
+	printf("running decode [%s]", c->name);
+
+	ret = c->f8_decode(encoded, encoded_sz, &out, &out_sz, test_realloc);
+	free(encoded);
+	if (ret != 0) {
+		printf("\n		error %d", ret);
+		goto err;
+	}
+
+	// compare the bits, NaN and -0.0 must be kept
+	size = MIN(c->in_sz * 8, out_sz);
+	if (c->in_sz * 8 != out_sz || memcmp(out, c->in, size) != 0) {
+		printf("\n		buffer compare not match \n");
+		test_print_bytes("actual", out, out_sz);
+		test_print_bytes("expect", c->in, c->in_sz * 8);
+		goto err;
+	}
+
+	printf(" \t  ... OK \n");
+
+	free(out);
+
+	return;
+
+err:
+	printf("\n");
+	ok = false;
+	free(out);
+}
+
+// a window of the gorilla XOR wider than 64 bits is rejected, the width 0 is
+// the width 64 and only valid without leading zeros
+static void run_corrupt_f8()
+{
+	printf("running window [f8 / corrupt]");
+
+	struct {
+		unsigned char window[2];
+		int expect;
+	} cases[] = {
+	    {{0xC0, 0x00}, 0},	// leading 0, width 64
+	    {{0xFF, 0x40}, -1}, // leading 31, width 40
+	    {{0xC2, 0x00}, -1}, // leading 1, width 64
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+		// the header of 2 float8, the first value 0, the window and its bits
+		unsigned char input[2 + 8 + 2 + 8] = {0x12, 2};
+		memcpy(input + 10, cases[i].window, 2);
+		memset(input + 12, 0xFF, 8);
+
+		unsigned char *out = NULL;
+		size_t out_sz = 0;
+		int ret = _f8_decode(input, sizeof(input), &out, &out_sz, test_realloc);
+		if (ret != cases[i].expect) {
+			printf("\n		corrupt window %zu is %s\n", i, ret == 0 ? "accepted" : "rejected");
+			ok = false;
+		}
+		free(out);
+	}
+
+	if (ok)
+		printf(" \t  ... OK \n");
 }
 
 static void run(Case *c)
@@ -213,86 +668,1058 @@ err:
 	free(out);
 }
 
-static void run_rand_u8(Case *c)
+// the format before the blocked series, the whole output is compressed by zstd
+static int test_u8_encode_zstd(
+    uint64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	unsigned char *raw = NULL;
+	size_t raw_sz = 0;
+	int ret = _u8_encode(input, input_sz, &raw, &raw_sz, realloc_func);
+	if (ret == 0)
+		ret = _zstd_encode(raw, raw_sz, output, output_sz, realloc_func);
+
+	free(raw);
+	return ret;
+}
+
+// the blocks are packed in frames of 128 deltas
+static int test_u8_encode_pfor(
+    uint64_t *input, size_t input_sz,		  //
+    unsigned char **output, size_t *output_sz,	  //
+    void *(*realloc_func)(void *, size_t, size_t) //
+)
+{
+	_u8_set_codec(TE_CODEC_PFOR);
+	int ret = _u8_series_encode(input, input_sz, output, output_sz, realloc_func);
+	_u8_set_codec(TE_CODEC_AUTO);
+	return ret;
+}
+
+// the output must be byte exact with the byte at a time reference encoder
+static void run_cross_u8(Case *c)
 {
 	if (c->skip)
 		return;
 
-	printf("running bench  [%s]", c->name);
+	printf("running cross  [%s]", c->name);
 
-	size_t out1_sz = 0, out2_sz = 0;
-	unsigned char *out1 = NULL, *out2 = NULL;
+	size_t input_sz = 20480, nround = 100;
+	uint64_t *input = malloc(input_sz * 8);
+
+	for (size_t round = 0; round < nround; ++round) {
+		size_t out1_sz = 0, out2_sz = 0, out3_sz = 0;
+		unsigned char *out1 = NULL, *out2 = NULL, *out3 = NULL;
+
+		test_fill(input, input_sz, c->pattern);
 
-	size_t input_sz = 20480, nround = 5000;
-	uint64_t *input = malloc(input_sz * MAX(c->base, 8));
+		int ret1 = c->u8_encode(input, input_sz, &out1, &out1_sz, test_realloc);
+		int ret2 = ref_u8_encode(input, input_sz, &out2, &out2_sz, test_realloc);
+		int ret3 = c->u8_decode(out2, out2_sz, &out3, &out3_sz, test_realloc);
+
+		bool match = ret1 == 0 && ret2 == 0 && ret3 == 0 && out1_sz == out2_sz &&
+			     memcmp(out1, out2, out1_sz) == 0 && out3_sz == input_sz * 8 &&
+			     memcmp(out3, input, out3_sz) == 0;
 
-	uint64_t en_bytes = 0;
-	double en_ms = 0, de_ms = 0;
+		free(out1), free(out2), free(out3);
 
-	for (int round = 0; round < nround; ++round) {
-		for (int i = 0; i < input_sz; ++i) {
-			if (c->pattern == PATTERN_RAND)
-				input[i] = ((uint64_t)rand() << 32 | rand());
-			else if (c->pattern == PATTERN_ORDERED)
-				input[i] = i;
-			else if (c->pattern == PATTERN_ZERO)
-				input[i] = 0;
+		if (!match) {
+			printf("\n		output not match with reference in round %zu\n", round);
+			ok = false;
+			free(input);
+			return;
 		}
+	}
+
+	printf(" \t  ... OK \n");
+	free(input);
+}
+
+// every length around the simd width and the 0b run length
+static void run_lengths_u8(Case *c)
+{
+	if (c->skip)
+		return;
 
-		struct timespec tstart = {0, 0}, tend = {0, 0};
+	printf("running length [%s]", c->name);
 
-		clock_gettime(CLOCK_MONOTONIC, &tstart);
-		int ret1 = c->u8_encode(input, input_sz, &out1, &out1_sz, test_realloc);
-		clock_gettime(CLOCK_MONOTONIC, &tend);
-		en_ms = clock_gettime_ms(&tend) - clock_gettime_ms(&tstart);
-		en_bytes += out1_sz;
+	uint64_t input[8193];
+	for (size_t input_sz = 0; input_sz <= 8193; input_sz += input_sz < 128 || input_sz > 4093 ? 1 : 3966) {
+		size_t out1_sz = 0, out2_sz = 0;
+		unsigned char *out1 = NULL, *out2 = NULL;
+
+		test_fill(input, input_sz, c->pattern);
 
-		clock_gettime(CLOCK_MONOTONIC, &tstart);
+		int ret1 = c->u8_encode(input, input_sz, &out1, &out1_sz, test_realloc);
 		int ret2 = c->u8_decode(out1, out1_sz, &out2, &out2_sz, test_realloc);
-		clock_gettime(CLOCK_MONOTONIC, &tend);
-		de_ms = clock_gettime_ms(&tend) - clock_gettime_ms(&tstart);
+		bool match = ret1 == 0 && ret2 == 0 && out2_sz == input_sz * 8 && memcmp(out2, input, out2_sz) == 0;
+
+		free(out1), free(out2);
 
-		if (ret1 != 0 || ret2 != 0) {
-			printf("\n		error encode %d decode %d", ret1, ret2);
-			goto err;
+		if (!match) {
+			printf("\n		roundtrip not match with length %zu\n", input_sz);
+			ok = false;
+			return;
 		}
+	}
+
+	printf(" \t  ... OK \n");
+}
+
+// the streaming encoder must be byte exact with the array encoder, also after
+// finish is called in the middle of the stream.
+static void run_stream_u8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running stream [%s]", c->name);
+
+	size_t input_sz = 20480;
+	uint64_t *input = malloc(input_sz * 8);
+	test_fill(input, input_sz, c->pattern);
+
+	U8Encoder *e = _u8_encoder_create(test_realloc);
+	for (size_t i = 0; i <= input_sz; ++i) {
+		if (i == input_sz || i < 130 || i % 997 == 0) {
+			size_t out1_sz = 0, out2_sz = 0;
+			unsigned char *out1 = NULL, *out2 = NULL;
 
-		if (memcmp(input, out2, input_sz * 8) != 0) {
-			printf("\n		buffer compare not match \n");
-			test_print_bytes("I ", (unsigned char *)input, input_sz * 8);
-			test_print_bytes("O ", (unsigned char *)out2, out2_sz);
-			goto err;
+			int ret1 = _u8_encoder_finish(e, &out1, &out1_sz);
+			int ret2 = c->u8_encode(input, i, &out2, &out2_sz, test_realloc);
+			bool match = ret1 == 0 && ret2 == 0 && out1_sz == out2_sz && memcmp(out1, out2, out1_sz) == 0;
+			free(out2);
+
+			if (!match) {
+				printf("\n		output not match with array encoder at %zu\n", i);
+				ok = false;
+				break;
+			}
 		}
 
-		free(out1), free(out2);
+		if (i < input_sz && _u8_encoder_append(e, input[i]) != 0) {
+			printf("\n		error append at %zu\n", i);
+			ok = false;
+			break;
+		}
 	}
 
-	const double _1MiB = 1024 * 1024;
-	const double _1GiB = 1024 * _1MiB;
-	printf(
-	    "\t  ... [decode %.2fGiB/s encode %.2fGiB/s | %.2fMiB -> %.2fMiB]\n",
-	    (1.0 * c->base * nround * input_sz / _1GiB) / (en_ms / 10e3),
-	    (1.0 * c->base * nround * input_sz / _1GiB) / (de_ms / 10e3),
-	    (1.0 * c->base * nround * input_sz / _1MiB),
-	    (double)en_bytes / _1MiB);
+	// append in chunks across the blocks
+	U8Encoder *e2 = _u8_encoder_create(test_realloc);
+	for (size_t i = 0; ok && i < input_sz; i += 1234)
+		_u8_encoder_append_n(e2, input + i, MIN(1234, input_sz - i));
 
-	free(input);
-	return;
+	size_t out1_sz = 0, out2_sz = 0;
+	unsigned char *out1 = NULL, *out2 = NULL;
+	_u8_encoder_finish(e2, &out1, &out1_sz);
+	c->u8_encode(input, input_sz, &out2, &out2_sz, test_realloc);
+	if (ok && (out1_sz != out2_sz || memcmp(out1, out2, out1_sz) != 0)) {
+		printf("\n		output not match with array encoder when append in chunks\n");
+		ok = false;
+	}
 
-err:
-	ok = false;
+	if (ok)
+		printf(" \t  ... OK \n");
+
+	free(out2);
+	_u8_encoder_free(e, free);
+	_u8_encoder_free(e2, free);
 	free(input);
-	free(out1), free(out2);
-	printf("\n");
 }
 
-int main()
+// the chunks encoded by the partial encoders, serialized and merged as the
+// parallel workers, must decode to the whole input
+static void run_merge_u8(Case *c)
 {
-	srand(0);
+	if (c->skip)
+		return;
+
+	printf("running merge  [%s]", c->name);
+
+	size_t input_sz = 20480;
+	uint64_t *input = malloc(input_sz * 8);
+	test_fill(input, input_sz, c->pattern);
+
+	size_t chunks[] = {0, 1, 100, 4096, 5000, 8192, 20480};
+	for (size_t k = 0; k < sizeof(chunks) / sizeof(chunks[0]) && ok; ++k) {
+		size_t chunk = chunks[k] == 0 ? input_sz : chunks[k];
+
+		U8Encoder *e = _u8_encoder_create(test_realloc);
+		for (size_t i = 0; i < input_sz && ok; i += chunk) {
+			U8Encoder *partial = _u8_encoder_create(test_realloc);
+			_u8_encoder_append_n(partial, input + i, MIN(chunk, input_sz - i));
+
+			unsigned char *state = NULL;
+			size_t state_sz = 0;
+			_u8_encoder_serialize(partial, &state, &state_sz);
+			U8Encoder *copy = _u8_encoder_deserialize(state, state_sz, test_realloc);
+
+			if (copy == NULL || _u8_encoder_merge(e, copy) != 0) {
+				printf("\n		merge failed with chunk %zu at %zu\n", chunk, i);
+				ok = false;
+			}
+
+			if (copy != NULL)
+				_u8_encoder_free(copy, free);
+			_u8_encoder_free(partial, free);
+			free(state);
+		}
+
+		unsigned char *out = NULL, *decoded = NULL;
+		size_t out_sz = 0, decoded_sz = 0;
+		int ret = _u8_encoder_finish(e, &out, &out_sz);
+		ret |= _u8_series_decode(out, out_sz, &decoded, &decoded_sz, test_realloc);
+		if (ok && (ret != 0 || decoded_sz != input_sz * 8 || memcmp(decoded, input, decoded_sz) != 0)) {
+			printf("\n		round trip not match with chunk %zu\n", chunk);
+			ok = false;
+		}
+
+		free(decoded);
+		_u8_encoder_free(e, free);
+	}
+
+	// a state whose index does not add up to the values is rejected, the
+	// index starts after the 24 bytes of the counts
+	U8Encoder *partial = _u8_encoder_create(test_realloc);
+	_u8_encoder_append_n(partial, input, 5000);
+
+	unsigned char *state = NULL;
+	size_t state_sz = 0;
+	_u8_encoder_serialize(partial, &state, &state_sz);
+
+	uint32_t corrupt[][2] = {{24 + 16, 4097}, {24 + 16, 4095}, {24 + 20, 0xFFFFFF}};
+	for (size_t k = 0; k < sizeof(corrupt) / sizeof(corrupt[0]); ++k) {
+		unsigned char *bad = malloc(state_sz);
+		memcpy(bad, state, state_sz);
+		memcpy(bad + corrupt[k][0], &corrupt[k][1], 4);
+
+		U8Encoder *copy = _u8_encoder_deserialize(bad, state_sz, test_realloc);
+		if (copy != NULL) {
+			printf("\n		corrupt state %zu is accepted\n", k);
+			_u8_encoder_free(copy, free);
+			ok = false;
+		}
+
+		free(bad);
+	}
+
+	_u8_encoder_free(partial, free);
+	free(state);
+
+	if (ok)
+		printf(" \t  ... OK \n");
+
+	free(input);
+}
+
+// the count, the first and the last value must be read from the prefix, the
+// index and the last block alone
+static void run_prefix_u8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running prefix [%s]", c->name);
+
+	size_t lengths[] = {0, 1, 2, 4095, 4096, 4097, 20480};
+	for (size_t k = 0; k < sizeof(lengths) / sizeof(lengths[0]) && ok; ++k) {
+		size_t input_sz = lengths[k], out_sz = 0, offset = 0;
+		uint64_t *input = malloc(input_sz * 8 + 8), first = 0, last = 0;
+		unsigned char *out = NULL;
+		uint32_t count = 0;
+		test_fill(input, input_sz, c->pattern);
+		c->u8_encode(input, input_sz, &out, &out_sz, test_realloc);
+
+		int index_sz = _u8_series_prefix(out, MIN(out_sz, 33 /* SERIES_PREFIX_SZ */), &count, &first);
+		int ret = index_sz < 0 || (size_t)index_sz > out_sz;
+		if (ret == 0 && input_sz > 0) {
+			ret |= _u8_series_tail(out, index_sz, &offset);
+			ret |= offset > out_sz || _u8_series_last(out, index_sz, out + offset, out_sz - offset, &last,
+								  test_realloc);
+		}
+
+		if (ret != 0 || count != input_sz ||
+		    (input_sz > 0 && (first != input[0] || last != input[input_sz - 1]))) {
+			printf("\n		prefix not match with %zu values\n", input_sz);
+			ok = false;
+		}
+
+		free(input);
+		free(out);
+	}
+
+	if (ok)
+		printf(" \t  ... OK \n");
+}
+
+// every column of the row group must be found from the directory alone and
+// decode to its input
+static void run_rowgroup(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running group  [%s]", c->name);
+
+	size_t input_sz = 20480;
+	uint64_t *inputs[3];
+	unsigned char *columns[3];
+	size_t column_sizes[3];
+	uint32_t types[3] = {1114, 20, 701};
+	for (int i = 0; i < 3; ++i) {
+		inputs[i] = malloc(input_sz * 8);
+		test_fill(inputs[i], input_sz, i == 0 ? PATTERN_JITTER : c->pattern);
+	}
+
+	_u8_series_encode(inputs[0], input_sz, &columns[0], &column_sizes[0], test_realloc);
+	_u8_series_encode(inputs[1], input_sz, &columns[1], &column_sizes[1], test_realloc);
+	_f8_encode((float64_t *)inputs[2], input_sz, &columns[2], &column_sizes[2], test_realloc);
+
+	unsigned char *out = NULL;
+	size_t out_sz = 0;
+	int ret = _rowgroup_encode(input_sz, 3, columns, column_sizes, types, &out, &out_sz, test_realloc);
+
+	uint32_t count = 0;
+	uint16_t ncolumns = 0;
+	int directory_sz = _rowgroup_directory_size(out, 6, &count, &ncolumns);
+	if (ret != 0 || directory_sz < 0 || count != input_sz || ncolumns != 3) {
+		printf("\n		invalid header\n");
+		ok = false;
+	}
+
+	for (uint16_t i = 0; i < 3 && ok; ++i) {
+		uint32_t type = 0;
+		size_t offset = 0, size = 0;
+		unsigned char *decoded = NULL;
+		size_t decoded_sz = 0;
+
+		ret = _rowgroup_column(out, directory_sz, i, &type, &offset, &size);
+		if (ret == 0 && offset + size <= out_sz)
+			ret = i == 2 ? _f8_decode(out + offset, size, &decoded, &decoded_sz, test_realloc)
+				     : _u8_series_decode(out + offset, size, &decoded, &decoded_sz, test_realloc);
+
+		if (ret != 0 || type != types[i] || size != column_sizes[i] || decoded_sz != input_sz * 8 ||
+		    memcmp(decoded, inputs[i], decoded_sz) != 0) {
+			printf("\n		column %d not match\n", i);
+			ok = false;
+		}
+
+		free(decoded);
+	}
+
+	uint32_t type = 0;
+	size_t offset = 0, size = 0;
+	if (ok && (_rowgroup_column(out, directory_sz, 3, &type, &offset, &size) == 0 ||
+		   _rowgroup_column(out, directory_sz - 1, 2, &type, &offset, &size) == 0 ||
+		   _rowgroup_column(columns[1], column_sizes[1], 0, &type, &offset, &size) == 0)) {
+		printf("\n		invalid column is accepted\n");
+		ok = false;
+	}
+
+	if (ok)
+		printf(" \t  ... OK \n");
+
+	for (int i = 0; i < 3; ++i)
+		free(inputs[i]), free(columns[i]);
+	free(out);
+}
+
+// the series extended by appends must be the same as the series encoded at once,
+// the first chunk may be in the format before the blocked series
+static void run_append_u8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running append [%s]", c->name);
+
+	size_t input_sz = 20480;
+	uint64_t *input = malloc(input_sz * 8);
+	test_fill(input, input_sz, c->pattern);
+
+	unsigned char *expected = NULL;
+	size_t expected_sz = 0;
+	_u8_series_encode(input, input_sz, &expected, &expected_sz, test_realloc);
+
+	size_t chunks[] = {1, 240, 4096, 5000, 20480};
+	for (size_t k = 0; k < sizeof(chunks) / sizeof(chunks[0]) && ok; ++k) {
+		size_t chunk = chunks[k];
+		unsigned char *out = NULL;
+		size_t out_sz = 0;
+		c->u8_encode(input, chunk, &out, &out_sz, test_realloc);
+
+		for (size_t i = chunk; i <= input_sz && ok; i += chunk) {
+			U8Encoder *e = _u8_encoder_open(out, out_sz, test_realloc);
+			unsigned char *next = NULL;
+			size_t next_sz = 0;
+			if (e == NULL || _u8_encoder_append_n(e, input + i, MIN(chunk, input_sz - i)) != 0 ||
+			    _u8_encoder_finish(e, &next, &next_sz) != 0) {
+				printf("\n		append failed with chunk %zu at %zu\n", chunk, i);
+				ok = false;
+			} else {
+				free(out);
+				out = malloc(next_sz);
+				memcpy(out, next, next_sz);
+				out_sz = next_sz;
+			}
+
+			if (e != NULL)
+				_u8_encoder_free(e, free);
+		}
+
+		if (ok && (out_sz != expected_sz || memcmp(out, expected, out_sz) != 0)) {
+			printf("\n		append not match with chunk %zu\n", chunk);
+			ok = false;
+		}
+
+		free(out);
+	}
+
+	if (ok)
+		printf(" \t  ... OK \n");
+
+	free(input);
+	free(expected);
+}
+
+// the slice must be the same as the range of the input
+static void run_slice_u8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running slice  [%s]", c->name);
+
+	size_t input_sz = 20480, out_sz = 0;
+	uint64_t *input = malloc(input_sz * 8);
+	unsigned char *out = NULL;
+	test_fill(input, input_sz, c->pattern);
+	c->u8_encode(input, input_sz, &out, &out_sz, test_realloc);
+
+	size_t ranges[][2] = {
+	    {0, 0}, {0, 1}, {1, 1}, {4095, 1}, {4096, 1}, {4095, 2}, {4000, 5000}, {20479, 1}, {20479, 10}, {20480, 1},
+	};
+	for (size_t i = 0; i < 1000 + sizeof(ranges) / sizeof(ranges[0]); ++i) {
+		size_t start = i < 1000 ? rand() % input_sz : ranges[i - 1000][0];
+		size_t count = i < 1000 ? (size_t)(rand() % 5000) : ranges[i - 1000][1];
+		size_t expect = MIN(count, input_sz - MIN(start, input_sz));
+
+		uint64_t *slice = NULL;
+		size_t slice_sz = 0;
+		int ret = _u8_series_slice(out, out_sz, start, count, &slice, &slice_sz, test_realloc);
+		bool match = ret == 0 && slice_sz == expect * 8 && memcmp(slice, input + start, slice_sz) == 0;
+		free(slice);
+
+		if (!match) {
+			printf("\n		slice not match with start %zu count %zu\n", start, count);
+			ok = false;
+			break;
+		}
+	}
+
+	if (ok)
+		printf(" \t  ... OK \n");
+
+	free(input), free(out);
+}
+
+// the range must be the values in [lo, hi] of the sorted input
+static void run_search_u8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running search [%s]", c->name);
+
+	size_t input_sz = 20480, out_sz = 0;
+	uint64_t *input = malloc(input_sz * 8);
+	unsigned char *out = NULL;
+	test_fill(input, input_sz, c->pattern);
+	c->u8_encode(input, input_sz, &out, &out_sz, test_realloc);
+
+	int64_t first = input[0], last = input[input_sz - 1];
+	for (int i = 0; i < 1000; ++i) {
+		int64_t lo = first - 10 + (int64_t)(rand() % 1000) * (last - first + 20) / 1000;
+		int64_t hi = lo + (int64_t)(rand() % 1000) * (last - first + 20) / 1000 - (last - first + 20) / 100;
+
+		size_t expect_start = 0, expect_end = 0;
+		while (expect_start < input_sz && (int64_t)input[expect_start] < lo)
+			++expect_start;
+		for (expect_end = expect_start; expect_end < input_sz && (int64_t)input[expect_end] <= hi;)
+			++expect_end;
+
+		size_t start = -1, count = -1;
+		int ret = _u8_series_search(out, out_sz, lo, hi, &start, &count, test_realloc);
+		if (ret != 0 || start != expect_start || count != expect_end - expect_start) {
+			printf("\n		search not match with lo %ld hi %ld\n", lo, hi);
+			ok = false;
+			break;
+		}
+	}
+
+	if (ok)
+		printf(" \t  ... OK \n");
+
+	free(input), free(out);
+}
+
+// the aggregates must be the same as computed from the input
+static void run_aggregate_u8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running agg    [%s]", c->name);
+
+	size_t lengths[] = {0, 1, 2, 3, 4095, 4096, 4097, 20480};
+	for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]) && ok; ++l) {
+		size_t input_sz = lengths[l], out_sz = 0;
+		uint64_t *input = malloc(input_sz * 8 + 8);
+		unsigned char *out = NULL;
+		test_fill(input, input_sz, c->pattern);
+		c->u8_encode(input, input_sz, &out, &out_sz, test_realloc);
+
+		__int128 sum = 0;
+		int64_t min = INT64_MAX, max = INT64_MIN;
+		for (size_t i = 0; i < input_sz; ++i) {
+			sum += (int64_t)input[i];
+			min = MIN(min, (int64_t)input[i]);
+			max = MAX(max, (int64_t)input[i]);
+		}
+
+		uint32_t count = 0, sum_count = 0, min_max_count = 0;
+		__int128 got_sum = 0;
+		int64_t got_min = INT64_MAX, got_max = INT64_MIN;
+		int ret = _u8_series_count(out, out_sz, &count, test_realloc);
+		ret |= _u8_series_sum(out, out_sz, &sum_count, &got_sum, test_realloc);
+		ret |= _u8_series_min_max(out, out_sz, &min_max_count, &got_min, &got_max, test_realloc);
+
+		if (ret != 0 || count != input_sz || sum_count != input_sz || min_max_count != input_sz || got_sum != sum ||
+		    got_min != min || got_max != max) {
+			printf("\n		aggregate not match with length %zu\n", input_sz);
+			ok = false;
+		}
+
+		free(input), free(out);
+	}
+
+	if (ok)
+		printf(" \t  ... OK \n");
+}
+
+// the codec of each block is chosen by size, the raw series must be smaller
+// than the delta of delta only format
+static void run_codec_u8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running codec  [%s]", c->name);
+
+	size_t input_sz = 20480;
+	uint64_t *input = malloc(input_sz * 8);
+	test_fill(input, input_sz, c->pattern);
+
+	_zstd_set_stage(TE_STAGE_NONE, 0);
+
+	unsigned char *out = NULL, *dod = NULL, *decoded = NULL;
+	size_t out_sz = 0, dod_sz = 0, decoded_sz = 0;
+	int ret = _u8_series_encode(input, input_sz, &out, &out_sz, test_realloc);
+	ret |= _u8_encode(input, input_sz, &dod, &dod_sz, test_realloc);
+	ret |= _u8_series_decode(out, out_sz, &decoded, &decoded_sz, test_realloc);
+
+	if (ret != 0 || decoded_sz != input_sz * 8 || memcmp(decoded, input, decoded_sz) != 0) {
+		printf("\n		round trip not match\n");
+		ok = false;
+	} else if (out_sz >= dod_sz) {
+		printf("\n		series %zu is not smaller than delta of delta %zu\n", out_sz, dod_sz);
+		ok = false;
+	} else if (c->pattern == PATTERN_REGULAR && out_sz >= input_sz) {
+		printf("\n		regular series %zu is not smaller than a byte per value\n", out_sz);
+		ok = false;
+	}
+
+	_zstd_set_stage(TE_STAGE_ZSTD, 0);
+
+	if (ok)
+		printf(" \t  ... OK \n");
+
+	free(out), free(dod), free(decoded), free(input);
+}
+
+// read the streaming decoder in batches of different size
+static void run_decoder_u8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running reader [%s]", c->name);
+
+	size_t input_sz = 20480, out_sz = 0;
+	uint64_t *input = malloc(input_sz * 8), *output = malloc(input_sz * 8);
+	unsigned char *out = NULL;
+	test_fill(input, input_sz, c->pattern);
+	c->u8_encode(input, input_sz, &out, &out_sz, test_realloc);
+
+	for (size_t batch = 1; batch <= 130; batch += 3) {
+		U8Decoder *d = _u8_decoder_create(out, out_sz, test_realloc);
+
+		size_t n = 0, ret = 0;
+		while (_u8_decoder_read(d, output + n, MIN(batch, input_sz - n + 1), &ret) == 0 && ret != 0)
+			n += ret;
+
+		_u8_decoder_free(d, free);
+
+		if (n != input_sz || memcmp(output, input, input_sz * 8) != 0) {
+			printf("\n		output not match with batch size %zu\n", batch);
+			ok = false;
+			break;
+		}
+	}
+
+	if (ok)
+		printf(" \t  ... OK \n");
+
+	free(input), free(output), free(out);
+}
+
+// the round trip of random inputs, the throughput is measured by bench_encode
+static void run_rand_u8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running round  [%s]", c->name);
+
+	size_t input_sz = 20480, nround = 100;
+	uint64_t *input = malloc(input_sz * 8);
+
+	for (size_t round = 0; round < nround; ++round) {
+		size_t out1_sz = 0, out2_sz = 0;
+		unsigned char *out1 = NULL, *out2 = NULL;
+
+		test_fill(input, input_sz, c->pattern);
+
+		int ret1 = c->u8_encode(input, input_sz, &out1, &out1_sz, test_realloc);
+		int ret2 = c->u8_decode(out1, out1_sz, &out2, &out2_sz, test_realloc);
+		bool match = ret1 == 0 && ret2 == 0 && out2_sz == input_sz * 8 && memcmp(input, out2, out2_sz) == 0;
+		free(out1), free(out2);
+
+		if (!match) {
+			printf("\n		roundtrip not match in round %zu\n", round);
+			ok = false;
+			free(input);
+			return;
+		}
+	}
+
+	printf(" \t  ... OK \n");
+	free(input);
+}
+
+static void run_rand_f8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running round  [%s]", c->name);
+
+	size_t input_sz = 20480, nround = 100;
+	uint64_t *input = malloc(input_sz * 8);
+
+	for (size_t round = 0; round < nround; ++round) {
+		size_t out1_sz = 0, out2_sz = 0;
+		unsigned char *out1 = NULL, *out2 = NULL;
+
+		test_fill(input, input_sz, c->pattern);
+
+		int ret1 = c->f8_encode((float64_t *)input, input_sz, &out1, &out1_sz, test_realloc);
+		int ret2 = c->f8_decode(out1, out1_sz, &out2, &out2_sz, test_realloc);
+		bool match = ret1 == 0 && ret2 == 0 && out2_sz == input_sz * 8 && memcmp(input, out2, out2_sz) == 0;
+		free(out1), free(out2);
+
+		if (!match) {
+			printf("\n		roundtrip not match in round %zu\n", round);
+			ok = false;
+			free(input);
+			return;
+		}
+	}
+
+	printf(" \t  ... OK \n");
+	free(input);
+}
+
+// the decimal series keeps the values which are not decimals as exceptions, and
+// must be smaller than the gorilla XOR of the same values
+static void run_codec_f8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running codec  [%s]", c->name);
+
+	size_t input_sz = 20480;
+	uint64_t *input = malloc(input_sz * 8);
+	test_fill(input, input_sz, c->pattern);
+
+	float64_t special[] = {0.0 / 0.0, -0.0, 1.0 / 0.0, 1e-300, 0.1 + 0.2, 123456789.123456789};
+	for (size_t i = 0; i < input_sz; i += 97)
+		memcpy(input + i, special + i % 6, 8);
+
+	_zstd_set_stage(TE_STAGE_NONE, 0);
+
+	unsigned char *out = NULL, *xor = NULL, *decoded = NULL;
+	size_t out_sz = 0, xor_sz = 0, decoded_sz = 0;
+	int ret = _f8_series_encode((float64_t *)input, input_sz, &out, &out_sz, test_realloc);
+	ret |= _f8_encode((float64_t *)input, input_sz, &xor, &xor_sz, test_realloc);
+	ret |= _f8_series_decode(out, out_sz, &decoded, &decoded_sz, test_realloc);
+
+	if (ret != 0 || decoded_sz != input_sz * 8 || memcmp(decoded, input, decoded_sz) != 0) {
+		printf("\n		round trip not match\n");
+		ok = false;
+	} else if (out_sz >= xor_sz) {
+		printf("\n		series %zu is not smaller than gorilla XOR %zu\n", out_sz, xor_sz);
+		ok = false;
+	}
+
+	_zstd_set_stage(TE_STAGE_ZSTD, 0);
+
+	if (ok)
+		printf(" \t  ... OK \n");
+
+	free(out), free(xor), free(decoded), free(input);
+}
+
+// the validity of the i-th value in the shapes of nulls of run_nulls_u8
+static bool test_valid(size_t i, size_t n, int shape)
+{
+	switch (shape) {
+	case 0: return true;
+	case 1: return i >= 1000;	    // leading nulls
+	case 2: return i < n - 1000;	    // trailing nulls
+	case 3: return false;		    // all null
+	case 4: return i % 7 != 0;	    // scattered nulls
+	default: return i / 500 % 2 == 0; // gaps of 500
+	}
+}
+
+// the values with nulls. the one shot, the streaming, the merged and the
+// reopened encoders must write the same output, the decoder reads the nulls in
+// place and the aggregates skip them.
+static void run_nulls_u8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running nulls  [%s]", c->name);
+
+	size_t input_sz = 20480, half = input_sz / 2, chunk = 1232;
+	uint64_t *input = malloc(input_sz * 8), *values = malloc(input_sz * 8), *output = malloc(input_sz * 8);
+	uint8_t *validity = malloc(input_sz / 8), *got_validity = malloc(input_sz / 8);
+	bool *nulls = malloc(input_sz), *got_nulls = malloc(input_sz);
+	test_fill(input, input_sz, c->pattern);
+
+	for (int shape = 0; shape < 6 && ok; ++shape) {
+		size_t nvalid = 0, nvalid_half = 0;
+		__int128 sum = 0;
+		memset(validity, 0, input_sz / 8);
+		for (size_t i = 0; i < input_sz; ++i) {
+			bool valid = test_valid(i, input_sz, shape);
+			nulls[i] = !valid;
+			validity[i / 8] |= valid << (i % 8);
+			if (valid)
+				values[nvalid++] = input[i], sum += (int64_t)input[i];
+
+			nvalid_half += valid && i < half;
+		}
+
+		unsigned char *out = NULL, *only = NULL, *stream = NULL, *reopened = NULL;
+		size_t out_sz = 0, only_sz = 0, stream_sz = 0, reopened_sz = 0;
+		int ret = _u8_series_encode_nulls(values, validity, input_sz, 0, &out, &out_sz, test_realloc);
+		ret |= _u8_series_encode(values, nvalid, &only, &only_sz, test_realloc);
+
+		// a value at a time in the first half, the partial encoders of chunks after
+		U8Encoder *e = _u8_encoder_create(test_realloc);
+		for (size_t i = 0, v = 0; i < half; ++i)
+			ret |= nulls[i] ? _u8_encoder_append_null(e) : _u8_encoder_append(e, values[v++]);
+
+		for (size_t i = half, v = nvalid_half; i < input_sz; i += chunk) {
+			size_t n = MIN(chunk, input_sz - i);
+			U8Encoder *partial = _u8_encoder_create(test_realloc);
+			ret |= _u8_encoder_append_nulls(partial, values + v, validity + i / 8, n);
+			for (size_t j = i; j < i + n; ++j)
+				v += !nulls[j];
+
+			unsigned char *state = NULL;
+			size_t state_sz = 0;
+			_u8_encoder_serialize(partial, &state, &state_sz);
+			U8Encoder *copy = _u8_encoder_deserialize(state, state_sz, test_realloc);
+			ret |= copy == NULL || _u8_encoder_merge(e, copy) != 0;
+
+			if (copy != NULL)
+				_u8_encoder_free(copy, free);
+			_u8_encoder_free(partial, free);
+			free(state);
+		}
+
+		ret |= _u8_encoder_finish(e, &stream, &stream_sz);
+
+		U8Encoder *o = _u8_encoder_open(out, out_sz, test_realloc);
+		ret |= o == NULL || _u8_encoder_finish(o, &reopened, &reopened_sz) != 0;
+
+		if (ret != 0 || stream_sz != out_sz || memcmp(stream, out, out_sz) != 0 || reopened_sz != out_sz ||
+		    memcmp(reopened, out, out_sz) != 0) {
+			printf("\n		output not match with array encoder with shape %d\n", shape);
+			ok = false;
+		}
+
+		// the nulls in place, in batches and after a seek
+		U8Decoder *d = _u8_decoder_create(out, out_sz, test_realloc);
+		size_t n = 0, read = 0;
+		while (_u8_decoder_read_nulls(d, output + n, got_nulls + n, MIN(333, input_sz - n + 1), &read) == 0 &&
+		       read != 0)
+			n += read;
+
+		bool match = d != NULL && _u8_decoder_count(d) == input_sz && n == input_sz &&
+			     memcmp(got_nulls, nulls, input_sz) == 0;
+		for (size_t i = 0; match && i < input_sz; ++i)
+			match = output[i] == (nulls[i] ? 0 : input[i]);
+
+		size_t positions[] = {0, 999, 1000, 1001, 4096, 10000, 19479, 20479};
+		for (size_t p = 0; match && p < sizeof(positions) / sizeof(positions[0]); ++p) {
+			size_t i = positions[p];
+			match = _u8_decoder_seek(d, i) == 0 &&
+				_u8_decoder_read_nulls(d, output, got_nulls, 1, &read) == 0 && read == 1 &&
+				got_nulls[0] == nulls[i] && output[0] == (nulls[i] ? 0 : input[i]);
+		}
+
+		if (!match) {
+			printf("\n		decoded nulls not match with shape %d\n", shape);
+			ok = false;
+		}
+
+		// the aggregates of the values which are not null
+		uint32_t count = 0, sum_count = 0, rows = 0, got_nvalid = 0;
+		__int128 got_sum = 0;
+		ret = _u8_series_count(out, out_sz, &count, test_realloc);
+		ret |= _u8_series_sum(out, out_sz, &sum_count, &got_sum, test_realloc);
+		if (ok && (ret != 0 || count != nvalid || sum_count != nvalid || got_sum != sum)) {
+			printf("\n		aggregate not match with shape %d\n", shape);
+			ok = false;
+		}
+
+		// the bitmap and the values as the data of a postgres array
+		unsigned char *got_values = NULL, *decoded = NULL;
+		size_t got_values_sz = 0, decoded_sz = 0;
+		ret = _nulls_exist(out, out_sz) != (nvalid != input_sz);
+		ret |= nvalid != input_sz && (_nulls_read(out, out_sz, &rows, &got_nvalid, got_validity, &got_values,
+							  &got_values_sz) != 0 ||
+					      rows != input_sz || got_nvalid != nvalid ||
+					      memcmp(got_validity, validity, input_sz / 8) != 0 ||
+					      _u8_series_decode(got_values, got_values_sz, &decoded,
+								&decoded_sz, test_realloc) != 0 ||
+					      decoded_sz != nvalid * 8 || memcmp(decoded, values, decoded_sz) != 0);
+		if (ok && ret != 0) {
+			printf("\n		validity not match with shape %d\n", shape);
+			ok = false;
+		}
+
+		// at most two bytes for a run of the gaps over the values alone
+		if (ok && shape == 5 && out_sz > only_sz + 2 * (input_sz / 500 + 1) + 16) {
+			printf("\n		series with gaps %zu is larger than values %zu\n", out_sz, only_sz);
+			ok = false;
+		}
+
+		if (d != NULL)
+			_u8_decoder_free(d, free);
+		if (o != NULL)
+			_u8_encoder_free(o, free);
+		_u8_encoder_free(e, free);
+		free(out), free(only), free(decoded);
+	}
+
+	if (ok)
+		printf(" \t  ... OK \n");
+
+	free(input), free(values), free(output), free(validity), free(got_validity), free(nulls), free(got_nulls);
+}
+
+// the values of the float8 series with nulls are the decimal series, or the
+// gorilla XOR. the streaming decoder reads the nulls in place, in batches and
+// after a seek.
+static void run_nulls_f8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running nulls  [%s]", c->name);
+
+	size_t input_sz = 20480;
+	uint64_t *input = malloc(input_sz * 8), *values = malloc(input_sz * 8), *output = malloc(input_sz * 8);
+	uint8_t *validity = malloc(input_sz / 8), *got_validity = malloc(input_sz / 8);
+	bool *nulls = malloc(input_sz), *got_nulls = malloc(input_sz);
+	test_fill(input, input_sz, c->pattern);
+
+	for (int shape = 0; shape <= 5; shape += shape == 0 ? 4 : 1) {
+		size_t nvalid = 0;
+		memset(validity, 0, input_sz / 8);
+		for (size_t i = 0; i < input_sz; ++i) {
+			bool valid = test_valid(i, input_sz, shape);
+			validity[i / 8] |= valid << (i % 8);
+			nulls[i] = !valid;
+			if (valid)
+				values[nvalid++] = input[i];
+		}
+
+		unsigned char *out = NULL, *got_values = NULL, *decoded = NULL;
+		size_t out_sz = 0, got_values_sz = 0, decoded_sz = 0;
+		uint32_t rows = 0, got_nvalid = 0;
+		int ret =
+		    _f8_series_encode_nulls((float64_t *)values, validity, input_sz, 0, &out, &out_sz, test_realloc);
+		ret |= shape != 0 && (_nulls_read(out, out_sz, &rows, &got_nvalid, got_validity, &got_values,
+						  &got_values_sz) != 0 ||
+				      rows != input_sz || got_nvalid != nvalid ||
+				      memcmp(got_validity, validity, input_sz / 8) != 0 ||
+				      _f8_series_decode(got_values, got_values_sz, &decoded, &decoded_sz,
+							test_realloc) != 0 ||
+				      decoded_sz != nvalid * 8 || memcmp(decoded, values, decoded_sz) != 0);
+		if (ret != 0) {
+			printf("\n		round trip not match with shape %d\n", shape);
+			ok = false;
+		}
+
+		U8Decoder *d = _f8_decoder_create(out, out_sz, test_realloc);
+		size_t n = 0, read = 0;
+		while (d != NULL &&
+		       _u8_decoder_read_nulls(d, output + n, got_nulls + n, MIN(333, input_sz - n + 1), &read) == 0 &&
+		       read != 0)
+			n += read;
+
+		// compare the bits, NaN and -0.0 must be kept
+		bool match = d != NULL && _u8_decoder_count(d) == input_sz && n == input_sz &&
+			     memcmp(got_nulls, nulls, input_sz) == 0;
+		for (size_t i = 0; match && i < input_sz; ++i)
+			match = output[i] == (nulls[i] ? 0 : input[i]);
+
+		size_t positions[] = {0, 999, 1000, 4095, 4096, 10000, 19479, 20479};
+		for (size_t p = 0; match && p < sizeof(positions) / sizeof(positions[0]); ++p) {
+			size_t i = positions[p];
+			match = _u8_decoder_seek(d, i) == 0 &&
+				_u8_decoder_read_nulls(d, output, got_nulls, 2, &read) == 0 &&
+				read == MIN(2, input_sz - i) && got_nulls[0] == nulls[i] &&
+				output[0] == (nulls[i] ? 0 : input[i]);
+		}
+
+		if (!match) {
+			printf("\n		decoded nulls not match with shape %d\n", shape);
+			ok = false;
+		}
+
+		if (d != NULL)
+			_u8_decoder_free(d, free);
+		free(out), free(decoded);
+	}
+
+	if (ok)
+		printf(" \t  ... OK \n");
+
+	free(input), free(values), free(output), free(validity), free(got_validity), free(nulls), free(got_nulls);
+}
+
+// the buckets of the lockstep decoders must match the rollup of the arrays
+static void run_bucket_u8(Case *c)
+{
+	if (c->skip)
+		return;
+
+	printf("running bucket [%s]", c->name);
+
+	size_t lengths[] = {0, 1, 4097, 20480};
+	int64_t widths[] = {1, 1000000, 60000000, 3600000000LL, 1LL << 60};
+	for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]) && ok; ++l) {
+		size_t input_sz = lengths[l], nvalid = 0;
+		uint64_t *ctime = malloc(input_sz * 8 + 8), *val = malloc(input_sz * 8 + 8);
+		uint8_t *validity = calloc(1, input_sz / 8 + 1);
+		test_fill(ctime, input_sz, PATTERN_JITTER);
+		test_fill(val, input_sz, c->pattern);
+		for (size_t i = 0; i < input_sz; ++i) {
+			validity[i / 8] |= (i % 13 != 0) << (i % 8);
+			if (i % 13 != 0)
+				val[nvalid++] = val[i];
+		}
+
+		unsigned char *ctime_out = NULL, *val_out = NULL;
+		size_t ctime_out_sz = 0, val_out_sz = 0;
+		_u8_series_encode(ctime, input_sz, &ctime_out, &ctime_out_sz, test_realloc);
+		_u8_series_encode_nulls(val, validity, input_sz, 0, &val_out, &val_out_sz, test_realloc);
+
+		for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]) && ok; ++w) {
+			int64_t width = widths[w];
+			U8Bucketer *b = _u8_bucketer_create(ctime_out, ctime_out_sz, val_out, val_out_sz, width,
+							    test_realloc, free);
+
+			bool match = b != NULL;
+			TimeBucket got, want;
+			for (size_t i = 0, v = 0; match && i < input_sz;) {
+				int64_t start = (int64_t)ctime[i] / width * width;
+				want = (TimeBucket){.start = start, .min = INT64_MAX, .max = INT64_MIN};
+				for (; i < input_sz && (int64_t)ctime[i] / width * width == start; ++i) {
+					if (i % 13 == 0)
+						continue;
+
+					int64_t x = val[v++];
+					want.first = want.count == 0 ? x : want.first;
+					want.last = x, want.sum += x, want.count++;
+					want.min = MIN(want.min, x), want.max = MAX(want.max, x);
+				}
+
+				match = _u8_bucketer_next(b, &got) == 1 && got.start == want.start &&
+					got.count == want.count && got.sum == want.sum;
+				match = match && (want.count == 0 || (got.min == want.min && got.max == want.max &&
+								      got.first == want.first && got.last == want.last));
+			}
+
+			if (!match || _u8_bucketer_next(b, &got) != 0) {
+				printf("\n		buckets not match with length %zu and width %ld\n", input_sz, width);
+				ok = false;
+			}
+
+			if (b != NULL)
+				_u8_bucketer_free(b, free);
+		}
+
+		// a width which is not positive and a val of a different count are rejected
+		unsigned char *half_out = NULL;
+		size_t half_out_sz = 0;
+		_u8_series_encode(ctime, input_sz / 2, &half_out, &half_out_sz, test_realloc);
+		U8Bucketer *zero =
+		    _u8_bucketer_create(ctime_out, ctime_out_sz, val_out, val_out_sz, 0, test_realloc, free);
+		U8Bucketer *half = _u8_bucketer_create(ctime_out, ctime_out_sz, half_out, half_out_sz, 60, test_realloc,
+						       free);
+		if (zero != NULL || (input_sz > 1 && half != NULL)) {
+			printf("\n		invalid input is accepted with length %zu\n", input_sz);
+			ok = false;
+		}
+
+		if (half != NULL)
+			_u8_bucketer_free(half, free);
+
+		free(ctime), free(val), free(validity), free(ctime_out), free(val_out), free(half_out);
+	}
+
+	if (ok)
+		printf(" \t  ... OK \n");
+}
+
+int main()
+{
+	srand(0);
 
 	run(&(Case){
 	    .name = "u8 / normal",
-	    .base = 8,
 	    .in = (unsigned char *)(int64_t[]){1, 2, 3},
 	    .in_sz = 3,
 	    .out =
@@ -318,7 +1745,6 @@ int main()
 
 	run(&(Case){
 	    .name = "u8 / signbit",
-	    .base = 8,
 	    .in = (unsigned char *)(int64_t[]){1, 2, 1},
 	    .in_sz = 3,
 	    .out =
@@ -343,7 +1769,6 @@ int main()
 
 	run(&(Case){
 	    .name = "u8 / overflow",
-	    .base = 8,
 	    .in =
 		(unsigned char *)(int64_t[]){
 		    0x6b8b4567327b23c6,
@@ -368,9 +1793,107 @@ int main()
 	    .u8_decode = _u8_decode,
 	});
 
+	run_f8(&(Case){
+	    .name = "f8 / normal",
+	    .in = (unsigned char *)(float64_t[]){1.0, 1.0, 2.0},
+	    .in_sz = 3,
+	    .out =
+		(unsigned char[]){
+		    // clang-format off
+			0b00000010 | 0b00010000,						// header DF8 SZ1
+			0x03,											// count
+			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf0, 0x3f, // first value
+
+			// 1.0 ^ 1.0 = 0, data: 0b(1bit)
+			// 1.0 ^ 2.0 = 0x7ff0000000000000, leading = 1, meaningful = 11
+			// data: 11b(2bit) + 00001b(5bit) + 001011b(6bit) + 11111111111b(11bit), padding = 7bit
+			0b01100001, 0b00101111, 0b11111111, 0b10000000,
+		    // clang-format on
+		},
+	    .out_sz = 1 + 1 + 8 + 4,
+	    .f8_encode = _f8_encode,
+	    .f8_decode = _f8_decode,
+	});
+
+	run_f8(&(Case){
+	    .name = "f8 / special",
+	    .in = (unsigned char *)(float64_t[]){0.0, -0.0, 1.0 / 0.0, -1.0 / 0.0, 0.0 / 0.0, 1e-300, 0.1, 0.1},
+	    .in_sz = 8,
+	    .f8_encode = _f8_encode,
+	    .f8_decode = _f8_decode,
+	});
+
+	run_f8(&(Case){
+	    .name = "f8 / empty",
+	    .in = (unsigned char *)(float64_t[]){0},
+	    .in_sz = 0,
+	    .out = (unsigned char[]){0b00000010 | 0b00010000, 0x00},
+	    .out_sz = 2,
+	    .f8_encode = _f8_encode,
+	    .f8_decode = _f8_decode,
+	});
+
+	run_rand_f8(&(Case){
+	    .name = "f8 / gauge",
+	    .pattern = PATTERN_GAUGE,
+	    .f8_encode = _f8_encode,
+	    .f8_decode = _f8_decode,
+	});
+
+	run_rand_f8(&(Case){
+	    .name = "f8 / rand",
+	    .pattern = PATTERN_RAND,
+	    .f8_encode = _f8_encode,
+	    .f8_decode = _f8_decode,
+	});
+
+	run_corrupt_f8();
+
+	run_f8(&(Case){
+	    .name = "f8 / series / special",
+	    .in = (unsigned char *)(float64_t[]){0.0, -0.0, 1.0 / 0.0, -1.0 / 0.0, 0.0 / 0.0, 1e-300, 0.1, 0.1},
+	    .in_sz = 8,
+	    .f8_encode = _f8_series_encode,
+	    .f8_decode = _f8_series_decode,
+	});
+
+	run_f8(&(Case){
+	    .name = "f8 / series / decimal",
+	    .in = (unsigned char *)(float64_t[]){0.25, 1.5, -2.75, 100, 1e9, 0.125, 3.0, 1e-3, -0.0},
+	    .in_sz = 9,
+	    .f8_encode = _f8_series_encode,
+	    .f8_decode = _f8_series_decode,
+	});
+
+	run_f8(&(Case){
+	    .name = "f8 / series / empty",
+	    .in = (unsigned char *)(float64_t[]){0},
+	    .in_sz = 0,
+	    .f8_encode = _f8_series_encode,
+	    .f8_decode = _f8_series_decode,
+	});
+
+	run_rand_f8(&(Case){
+	    .name = "f8 / series / gauge",
+	    .pattern = PATTERN_GAUGE,
+	    .f8_encode = _f8_series_encode,
+	    .f8_decode = _f8_series_decode,
+	});
+
+	run_rand_f8(&(Case){
+	    .name = "f8 / series / rand",
+	    .pattern = PATTERN_RAND,
+	    .f8_encode = _f8_series_encode,
+	    .f8_decode = _f8_series_decode,
+	});
+
+	run_codec_f8(&(Case){
+	    .name = "f8 / series / gauge",
+	    .pattern = PATTERN_GAUGE,
+	});
+
 	run_rand_u8(&(Case){
 	    .name = "u8 / rand",
-	    .base = 8,
 	    .pattern = PATTERN_RAND,
 	    .u8_encode = _u8_encode,
 	    .u8_decode = _u8_decode,
@@ -378,14 +1901,357 @@ int main()
 
 	run_rand_u8(&(Case){
 	    .name = "u8 / ordered",
-	    .base = 8,
 	    .pattern = PATTERN_ORDERED,
 	    .u8_encode = _u8_encode,
 	    .u8_decode = _u8_decode,
 	});
 
-	run_memcpy();
-	run_zstd();
+	run_cross_u8(&(Case){
+	    .name = "u8 / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = _u8_encode,
+	    .u8_decode = _u8_decode,
+	});
+
+	run_lengths_u8(&(Case){
+	    .name = "u8 / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = _u8_encode,
+	    .u8_decode = _u8_decode,
+	});
+
+	run_lengths_u8(&(Case){
+	    .name = "u8 / series / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = _u8_series_encode,
+	    .u8_decode = _u8_series_decode,
+	});
+
+	run_stream_u8(&(Case){
+	    .name = "u8 / series / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = _u8_series_encode,
+	    .u8_decode = _u8_series_decode,
+	});
+
+	run_merge_u8(&(Case){
+	    .name = "u8 / series / mixed",
+	    .pattern = PATTERN_MIXED,
+	});
+
+	run_merge_u8(&(Case){
+	    .name = "u8 / series / jitter",
+	    .pattern = PATTERN_JITTER,
+	});
+
+	run_append_u8(&(Case){
+	    .name = "u8 / series / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_append_u8(&(Case){
+	    .name = "u8 / zstd / jitter",
+	    .pattern = PATTERN_JITTER,
+	    .u8_encode = test_u8_encode_zstd,
+	});
+
+	run_prefix_u8(&(Case){
+	    .name = "u8 / series / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_prefix_u8(&(Case){
+	    .name = "u8 / pfor / jitter",
+	    .pattern = PATTERN_JITTER,
+	    .u8_encode = test_u8_encode_pfor,
+	});
+
+	run_rowgroup(&(Case){
+	    .name = "u8 / series / mixed",
+	    .pattern = PATTERN_MIXED,
+	});
+
+	run_decoder_u8(&(Case){
+	    .name = "u8 / series / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = _u8_series_encode,
+	    .u8_decode = _u8_series_decode,
+	});
+
+	run_decoder_u8(&(Case){
+	    .name = "u8 / zstd / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = test_u8_encode_zstd,
+	    .u8_decode = _u8_series_decode,
+	});
+
+	run_decoder_u8(&(Case){
+	    .name = "u8 / series / regular",
+	    .pattern = PATTERN_REGULAR,
+	    .u8_encode = _u8_series_encode,
+	    .u8_decode = _u8_series_decode,
+	});
+
+	run_slice_u8(&(Case){
+	    .name = "u8 / series / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = _u8_series_encode,
+	    .u8_decode = _u8_series_decode,
+	});
+
+	run_slice_u8(&(Case){
+	    .name = "u8 / zstd / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = test_u8_encode_zstd,
+	    .u8_decode = _u8_series_decode,
+	});
+
+	run_search_u8(&(Case){
+	    .name = "u8 / series / jitter",
+	    .pattern = PATTERN_JITTER,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_search_u8(&(Case){
+	    .name = "u8 / series / zero",
+	    .pattern = PATTERN_ZERO,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_search_u8(&(Case){
+	    .name = "u8 / series / regular",
+	    .pattern = PATTERN_REGULAR,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_search_u8(&(Case){
+	    .name = "u8 / zstd / jitter",
+	    .pattern = PATTERN_JITTER,
+	    .u8_encode = test_u8_encode_zstd,
+	});
+
+	run_aggregate_u8(&(Case){
+	    .name = "u8 / series / jitter",
+	    .pattern = PATTERN_JITTER,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_aggregate_u8(&(Case){
+	    .name = "u8 / series / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_aggregate_u8(&(Case){
+	    .name = "u8 / series / regular",
+	    .pattern = PATTERN_REGULAR,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_aggregate_u8(&(Case){
+	    .name = "u8 / series / rand",
+	    .pattern = PATTERN_RAND,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_aggregate_u8(&(Case){
+	    .name = "u8 / zstd / jitter",
+	    .pattern = PATTERN_JITTER,
+	    .u8_encode = test_u8_encode_zstd,
+	});
+
+	run_lengths_u8(&(Case){
+	    .name = "u8 / ordered",
+	    .pattern = PATTERN_ORDERED,
+	    .u8_encode = _u8_encode,
+	    .u8_decode = _u8_decode,
+	});
+
+	run_rand_u8(&(Case){
+	    .name = "u8 / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = _u8_encode,
+	    .u8_decode = _u8_decode,
+	});
+
+	run_rand_u8(&(Case){
+	    .name = "u8 / series / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = _u8_series_encode,
+	    .u8_decode = _u8_series_decode,
+	});
+
+	run_rand_u8(&(Case){
+	    .name = "u8 / series / ordered",
+	    .pattern = PATTERN_ORDERED,
+	    .u8_encode = _u8_series_encode,
+	    .u8_decode = _u8_series_decode,
+	});
+
+	run_rand_u8(&(Case){
+	    .name = "u8 / mixed / byte ref",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = ref_u8_encode,
+	    .u8_decode = ref_u8_decode,
+	});
+
+	run_rand_u8(&(Case){
+	    .name = "u8 / ordered / byte ref",
+	    .pattern = PATTERN_ORDERED,
+	    .u8_encode = ref_u8_encode,
+	    .u8_decode = ref_u8_decode,
+	});
+
+	run_lengths_u8(&(Case){
+	    .name = "u8 / pfor / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = test_u8_encode_pfor,
+	    .u8_decode = _u8_series_decode,
+	});
+
+	run_decoder_u8(&(Case){
+	    .name = "u8 / pfor / noise",
+	    .pattern = PATTERN_NOISE,
+	    .u8_encode = test_u8_encode_pfor,
+	});
+
+	run_slice_u8(&(Case){
+	    .name = "u8 / pfor / mixed",
+	    .pattern = PATTERN_MIXED,
+	    .u8_encode = test_u8_encode_pfor,
+	});
+
+	run_aggregate_u8(&(Case){
+	    .name = "u8 / pfor / jitter",
+	    .pattern = PATTERN_JITTER,
+	    .u8_encode = test_u8_encode_pfor,
+	});
+
+	run_rand_u8(&(Case){
+	    .name = "u8 / series / noise",
+	    .pattern = PATTERN_NOISE,
+	    .u8_encode = _u8_series_encode,
+	    .u8_decode = _u8_series_decode,
+	});
+
+	run_rand_u8(&(Case){
+	    .name = "u8 / pfor / noise",
+	    .pattern = PATTERN_NOISE,
+	    .u8_encode = test_u8_encode_pfor,
+	    .u8_decode = _u8_series_decode,
+	});
+
+	run_codec_u8(&(Case){
+	    .name = "u8 / series / ordered",
+	    .pattern = PATTERN_ORDERED,
+	});
+
+	run_codec_u8(&(Case){
+	    .name = "u8 / series / step",
+	    .pattern = PATTERN_STEP,
+	});
+
+	run_codec_u8(&(Case){
+	    .name = "u8 / series / noise",
+	    .pattern = PATTERN_NOISE,
+	});
+
+	run_codec_u8(&(Case){
+	    .name = "u8 / series / regular",
+	    .pattern = PATTERN_REGULAR,
+	});
+
+	run_stream_u8(&(Case){
+	    .name = "u8 / series / step",
+	    .pattern = PATTERN_STEP,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_stream_u8(&(Case){
+	    .name = "u8 / series / noise",
+	    .pattern = PATTERN_NOISE,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_slice_u8(&(Case){
+	    .name = "u8 / series / step",
+	    .pattern = PATTERN_STEP,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_slice_u8(&(Case){
+	    .name = "u8 / series / noise",
+	    .pattern = PATTERN_NOISE,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_aggregate_u8(&(Case){
+	    .name = "u8 / series / step",
+	    .pattern = PATTERN_STEP,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_aggregate_u8(&(Case){
+	    .name = "u8 / series / noise",
+	    .pattern = PATTERN_NOISE,
+	    .u8_encode = _u8_series_encode,
+	});
+
+	run_zstd_frames();
+
+	run_stage_u8(&(Case){
+	    .name = "u8 / series / ordered",
+	    .pattern = PATTERN_ORDERED,
+	});
+
+	run_stage_u8(&(Case){
+	    .name = "u8 / series / mixed",
+	    .pattern = PATTERN_MIXED,
+	});
+
+	run_stage_u8(&(Case){
+	    .name = "u8 / series / rand",
+	    .pattern = PATTERN_RAND,
+	});
+
+	run_dictionary_u8();
+
+	run_nulls_u8(&(Case){
+	    .name = "u8 / series / step",
+	    .pattern = PATTERN_STEP,
+	});
+
+	run_nulls_u8(&(Case){
+	    .name = "u8 / series / regular",
+	    .pattern = PATTERN_REGULAR,
+	});
+
+	run_nulls_u8(&(Case){
+	    .name = "u8 / series / rand",
+	    .pattern = PATTERN_RAND,
+	});
+
+	run_nulls_f8(&(Case){
+	    .name = "f8 / series / gauge",
+	    .pattern = PATTERN_GAUGE,
+	});
+
+	run_nulls_f8(&(Case){
+	    .name = "f8 / series / rand",
+	    .pattern = PATTERN_RAND,
+	});
+
+	run_bucket_u8(&(Case){
+	    .name = "u8 / series / noise",
+	    .pattern = PATTERN_NOISE,
+	});
+
+	run_bucket_u8(&(Case){
+	    .name = "u8 / series / rand",
+	    .pattern = PATTERN_RAND,
+	});
 
 	return !ok;
 }